@@ -1,15 +1,35 @@
 #pragma once
 
 #include <utility>
+#include <cstddef>
 
 using QValue = double;
 using QAction = std::pair<int, int>;
 
-class Board;
+template <int Size, int WinLength>
+class BasicBoard;
+using Board = BasicBoard<3, 3>;
+class Random;
 
-class Agent {
+// Agents are written against the board configuration they play on. Game loops
+// are templates over the agent types, so concrete (final) agents are called
+// directly and only loops given a BasicAgent reference dispatch virtually.
+template <typename GameBoard>
+class BasicAgent {
 public:
-    virtual ~Agent() = default;
+    using BoardType = GameBoard;
 
-    virtual QAction chooseAction(const Board& game) const = 0;
+    virtual ~BasicAgent() = default;
+
+    virtual QAction chooseAction(const GameBoard& game, Random& random) const = 0;
+
+    // Sets actions[i] to the action chosen for games[i]; agents that can share
+    // work between positions override it.
+    virtual void chooseActions(const GameBoard* games, QAction* actions, const std::size_t count, Random& random) const {
+        for (std::size_t i = 0; i < count; ++i) {
+            actions[i] = chooseAction(games[i], random);
+        }
+    }
 };
+
+using Agent = BasicAgent<Board>;
@@ -0,0 +1,129 @@
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <new>
+#include <algorithm>
+#include <cstdlib>
+#include <cstddef>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// The replacements live in their own translation unit, so callers never
+// inline a delete into the free() of a pointer from new.
+static std::atomic<long long> allocationsCount{0};
+
+long long getAllocationsCount() {
+    return allocationsCount.load(std::memory_order_relaxed);
+}
+
+static void* allocate(const std::size_t size) {
+    allocationsCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+static void* allocateAligned(const std::size_t size, const std::align_val_t alignment) {
+    allocationsCount.fetch_add(1, std::memory_order_relaxed);
+    const auto bytes = std::size_t(alignment);
+#if defined(_WIN32)
+    return _aligned_malloc(size ? size : 1, bytes);
+#else
+    // aligned_alloc() takes sizes in whole multiples of the alignment.
+    return std::aligned_alloc(bytes, (std::max(size, std::size_t(1)) + bytes - 1) / bytes * bytes);
+#endif
+}
+
+static void deallocateAligned(void* pointer) {
+#if defined(_WIN32)
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
+
+void* operator new(const std::size_t size) {
+    if (void* pointer = allocate(size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](const std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(const std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](const std::size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment) {
+    if (void* pointer = allocateAligned(size, alignment)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocateAligned(size, alignment);
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    deallocateAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept {
+    deallocateAligned(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept {
+    deallocateAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept {
+    deallocateAligned(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+    deallocateAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept {
+    deallocateAligned(pointer);
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Heap allocations made by the process so far, counted by the global
+// operator new and operator new[] of allocation_counter.cpp, aligned and
+// nothrow forms included. Only executables linking that file count them.
+long long getAllocationsCount();
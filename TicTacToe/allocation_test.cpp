@@ -0,0 +1,67 @@
+#include "game.h"
+#include "qvalues_agent.h"
+#include "minmax_agent.h"
+#include "training.h"
+#include "update_rules.h"
+#include "allocation_counter.h"
+
+#include <iostream>
+#include <string>
+
+// Plays learning episodes with the dense Q-table, which keeps all its state
+// inline or in tables allocated up front: once warmed up they must not
+// allocate. Seeded, so every run plays the same episodes.
+constexpr int WARMUP_EPISODES = 2000;
+constexpr int CHECKED_EPISODES = 2000;
+
+template <typename Episode>
+bool checkAllocationFree(const std::string& name, Episode&& episode) {
+    for (int i = 0; i < WARMUP_EPISODES; ++i) {
+        episode();
+    }
+    const auto before = getAllocationsCount();
+    for (int i = 0; i < CHECKED_EPISODES; ++i) {
+        episode();
+    }
+    const auto allocations = getAllocationsCount() - before;
+    std::cout << name << ": " << allocations << " allocations in " << CHECKED_EPISODES << " episodes" << std::endl;
+    return allocations == 0;
+}
+
+int main() {
+    Random random(1);
+    EpisodeStats stats;
+    const RandomAgent randomAgent;
+    const MinMaxAgent minMaxAsSecond(Board::SECOND_PLAYER);
+    const MinMaxAgent minMaxAsFirst(Board::FIRST_PLAYER);
+    bool passed = true;
+
+    QValuesAgent firstPlayer;
+    passed &= checkAllocationFree("first-player/random", [&] {
+        playLearningEpisodeOfFirstPlayer(firstPlayer, randomAgent, 0.3, random, stats);
+    });
+    passed &= checkAllocationFree("first-player/minmax", [&] {
+        playLearningEpisodeOfFirstPlayer(firstPlayer, minMaxAsSecond, 0.3, random, stats);
+    });
+
+    QValuesAgent secondPlayer;
+    passed &= checkAllocationFree("second-player/random", [&] {
+        playLearningEpisodeOfSecondPlayer(secondPlayer, randomAgent, 0.3, random, stats);
+    });
+    passed &= checkAllocationFree("second-player/minmax", [&] {
+        playLearningEpisodeOfSecondPlayer(secondPlayer, minMaxAsFirst, 0.3, random, stats);
+    });
+
+    for (const auto rule : {UpdateRule::NStep, UpdateRule::ReplacingTraces}) {
+        QValuesAgent agent;
+        UpdateRuleOptions options;
+        options.rule = rule;
+        EpisodeLearner<DenseQTable> learn(agent, options, LEARNING_RATE, DISCOUNT_FACTOR, stats);
+        passed &= checkAllocationFree(rule == UpdateRule::NStep ? "first-player/random/n-step"
+                                                                : "first-player/random/replacing-traces", [&] {
+            playEpisodeOfFirstPlayer(agent, randomAgent, 0.3, random, stats, false, learn);
+        });
+    }
+
+    return passed ? 0 : 1;
+}
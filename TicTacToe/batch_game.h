@@ -0,0 +1,225 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "game.h"
+#include "agent.h"
+#include "random.h"
+
+// Many boards in structure-of-arrays form: the masks of all boards are stored
+// contiguously per player, so status and legal moves of LANES boards are
+// computed by one vector instruction sequence (AVX2 when the build enables
+// it, a scalar loop otherwise). Boards are advanced in lockstep, one ply for
+// all of them per applyMoves() call.
+class BoardBatch final {
+public:
+    using Status = std::uint16_t;
+
+    constexpr static const Status ONGOING = 0;
+    constexpr static const Status FIRST_PLAYER_WON = 1;
+    constexpr static const Status SECOND_PLAYER_WON = 2;
+    constexpr static const Status DRAW = 3;
+
+    // Boards processed per vector step: 16 16-bit masks per 256-bit register.
+    constexpr static const std::size_t LANES = 16;
+    constexpr static const int NO_MOVE = -1;
+
+    explicit BoardBatch(const std::size_t count)
+        : m_count(count)
+        , m_first(paddedSize(count), 0)
+        , m_second(paddedSize(count), 0)
+        , m_status(paddedSize(count), ONGOING)
+        , m_legal(paddedSize(count), 0)
+        , m_moves(count, NO_MOVE)
+        , m_boards(count)
+        , m_actions(count) {
+        // Padding boards are full so they never take part in a game.
+        for (auto i = count; i < m_first.size(); ++i) {
+            m_first[i] = Board::FULL_MASK;
+        }
+        update();
+    }
+
+    std::size_t size() const {
+        return m_count;
+    }
+
+    void reset() {
+        std::fill(m_first.begin(), m_first.begin() + m_count, 0);
+        std::fill(m_second.begin(), m_second.begin() + m_count, 0);
+        update();
+    }
+
+    Board getBoard(const std::size_t index) const {
+        return Board::fromMasks(m_first[index], m_second[index]);
+    }
+
+    Status getStatus(const std::size_t index) const {
+        return m_status[index];
+    }
+
+    Board::Mask getLegalMoves(const std::size_t index) const {
+        return m_legal[index];
+    }
+
+    std::size_t getOngoingCount() const {
+        std::size_t ongoing = 0;
+        for (std::size_t i = 0; i < m_count; ++i) {
+            ongoing += m_status[i] == ONGOING;
+        }
+        return ongoing;
+    }
+
+    // Scratch buffer for the next applyMoves(), one cell per board, owned by
+    // the batch so playing a game allocates nothing.
+    std::int8_t* getMovesBuffer() {
+        return m_moves.data();
+    }
+
+    // Scratch buffers for policies that hand positions to an agent in bulk.
+    Board* getBoardsBuffer() {
+        return m_boards.data();
+    }
+
+    QAction* getActionsBuffer() {
+        return m_actions.data();
+    }
+
+    // cells[i] is the cell the player takes on board i, or NO_MOVE.
+    void applyMoves(const std::int8_t* cells, const char player) {
+        auto& masks = player == Board::FIRST_PLAYER ? m_first : m_second;
+        for (std::size_t i = 0; i < m_count; ++i) {
+            if (cells[i] != NO_MOVE) {
+                masks[i] |= Board::Mask(1 << cells[i]);
+            }
+        }
+        update();
+    }
+
+private:
+    static std::size_t paddedSize(const std::size_t count) {
+        return (count + LANES - 1) / LANES * LANES;
+    }
+
+    // Recomputes status and legal moves of every board. A win takes precedence
+    // over a full board, as in Board::getAggressiveReward().
+    void update() {
+        const auto size = m_first.size();
+#if defined(__AVX2__)
+        const auto full = _mm256_set1_epi16(short(Board::FULL_MASK));
+        const auto firstWon = _mm256_set1_epi16(short(FIRST_PLAYER_WON));
+        const auto secondWon = _mm256_set1_epi16(short(SECOND_PLAYER_WON));
+        const auto draw = _mm256_set1_epi16(short(DRAW));
+        for (std::size_t i = 0; i < size; i += LANES) {
+            const auto first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&m_first[i]));
+            const auto second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&m_second[i]));
+            auto firstLine = _mm256_setzero_si256();
+            auto secondLine = _mm256_setzero_si256();
+            for (const auto line : Board::WIN_MASKS) {
+                const auto mask = _mm256_set1_epi16(short(line));
+                firstLine = _mm256_or_si256(firstLine, _mm256_cmpeq_epi16(_mm256_and_si256(first, mask), mask));
+                secondLine = _mm256_or_si256(secondLine, _mm256_cmpeq_epi16(_mm256_and_si256(second, mask), mask));
+            }
+            const auto occupied = _mm256_or_si256(first, second);
+            const auto isFull = _mm256_cmpeq_epi16(occupied, full);
+
+            auto status = _mm256_and_si256(isFull, draw);
+            status = _mm256_blendv_epi8(status, secondWon, secondLine);
+            status = _mm256_blendv_epi8(status, firstWon, firstLine);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&m_status[i]), status);
+
+            // Finished boards have no legal moves.
+            const auto legal = _mm256_andnot_si256(occupied, full);
+            const auto ongoing = _mm256_cmpeq_epi16(status, _mm256_setzero_si256());
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&m_legal[i]), _mm256_and_si256(legal, ongoing));
+        }
+#else
+        for (std::size_t i = 0; i < size; ++i) {
+            Status status = (m_first[i] | m_second[i]) == Board::FULL_MASK ? DRAW : ONGOING;
+            for (const auto line : Board::WIN_MASKS) {
+                if ((m_second[i] & line) == line) status = SECOND_PLAYER_WON;
+            }
+            for (const auto line : Board::WIN_MASKS) {
+                if ((m_first[i] & line) == line) status = FIRST_PLAYER_WON;
+            }
+            m_status[i] = status;
+            m_legal[i] = status == ONGOING ? Board::Mask(~(m_first[i] | m_second[i]) & Board::FULL_MASK) : 0;
+        }
+#endif
+    }
+
+    std::size_t m_count;
+    std::vector<Board::Mask> m_first;
+    std::vector<Board::Mask> m_second;
+    std::vector<Status> m_status;
+    std::vector<Board::Mask> m_legal;
+    std::vector<std::int8_t> m_moves;
+    std::vector<Board> m_boards;
+    std::vector<QAction> m_actions;
+};
+
+// Uniformly random cell of a non-empty mask.
+inline int selectRandomCell(const Board::Mask mask, Random& random) {
+    return Board::getRandomCell(mask, random);
+}
+
+// Policies choose the cells of one ply, policy(batch, cells, random) sets
+// cells[i] for every board i of the batch that has legal moves.
+struct RandomBatchPolicy {
+    void operator()(BoardBatch& batch, std::int8_t* cells, Random& random) const {
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (batch.getLegalMoves(i)) {
+                cells[i] = std::int8_t(selectRandomCell(batch.getLegalMoves(i), random));
+            }
+        }
+    }
+};
+
+// Hands all ongoing boards of the ply to one Agent::chooseActions() call.
+template <typename AgentType>
+struct AgentBatchPolicy {
+    const AgentType& agent;
+
+    void operator()(BoardBatch& batch, std::int8_t* cells, Random& random) const {
+        auto* boards = batch.getBoardsBuffer();
+        auto* actions = batch.getActionsBuffer();
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (batch.getLegalMoves(i)) {
+                boards[count++] = batch.getBoard(i);
+            }
+        }
+        agent.chooseActions(boards, actions, count, random);
+        count = 0;
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (batch.getLegalMoves(i)) {
+                cells[i] = std::int8_t(Board::toCell(actions[count++]));
+            }
+        }
+    }
+};
+
+// Plays a game from the empty position on every board of the batch.
+template <typename FirstPolicy, typename SecondPolicy>
+void playBatch(BoardBatch& batch, const FirstPolicy& firstPolicy, const SecondPolicy& secondPolicy, Random& random) {
+    batch.reset();
+    auto* cells = batch.getMovesBuffer();
+    char player = Board::FIRST_PLAYER;
+    while (batch.getOngoingCount() > 0) {
+        std::fill(cells, cells + batch.size(), std::int8_t(BoardBatch::NO_MOVE));
+        if (player == Board::FIRST_PLAYER) {
+            firstPolicy(batch, cells, random);
+        } else {
+            secondPolicy(batch, cells, random);
+        }
+        batch.applyMoves(cells, player);
+        player = getOponent(player);
+    }
+}
@@ -0,0 +1,552 @@
+#include "game.h"
+#include "qvalues_agent.h"
+#include "minmax_agent.h"
+#include "mcts_agent.h"
+#include "training.h"
+#include "evaluation.h"
+#include "checkpoint.h"
+#include "policy_agent.h"
+#include "tournament.h"
+#include "allocation_counter.h"
+
+#include <fstream>
+#include <filesystem>
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Keeps the compiler from discarding a computed value.
+template <typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r"(&value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+struct BenchmarkResult {
+    std::string name;
+    long long iterations = 0;
+    double seconds = 0;
+    long long allocations = 0;
+    // Set for operations that must not allocate once warmed up.
+    bool allocationFree = false;
+
+    double nanosPerOperation() const {
+        return seconds * 1e9 / iterations;
+    }
+
+    double operationsPerSecond() const {
+        return iterations / seconds;
+    }
+
+    double allocationsPerOperation() const {
+        return double(allocations) / iterations;
+    }
+
+    bool failed() const {
+        return allocationFree && allocations > 0;
+    }
+};
+
+struct BenchmarkOptions {
+    std::string format = "text";
+    std::string output;
+    std::string filter;
+    double minSeconds = 0.2;
+};
+
+class BenchmarkRunner final {
+public:
+    explicit BenchmarkRunner(const BenchmarkOptions& options) : m_options(options) {}
+
+    // Calls operation() in batches of doubling size until a batch runs for
+    // at least minSeconds; operation performs one measured operation.
+    // Allocations are counted over the last batch, after the earlier ones
+    // have warmed up caches and tables, and must be zero when allocationFree.
+    void run(const std::string& name, const std::function<void()>& operation, const bool allocationFree = false) {
+        if (name.find(m_options.filter) == std::string::npos) {
+            return;
+        }
+
+        BenchmarkResult result{name};
+        result.allocationFree = allocationFree;
+        for (long long iterations = 1;; iterations *= 2) {
+            const auto allocations = getAllocationsCount();
+            const auto start = std::chrono::steady_clock::now();
+            for (long long i = 0; i < iterations; ++i) {
+                operation();
+            }
+            const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (seconds >= m_options.minSeconds) {
+                result.iterations = iterations;
+                result.seconds = seconds;
+                result.allocations = getAllocationsCount() - allocations;
+                break;
+            }
+        }
+
+        m_results.push_back(result);
+    }
+
+    // Names the allocation-free operations that allocated.
+    bool checkAllocations(std::ostream& ss) const {
+        bool passed = true;
+        for (const auto& result : m_results) {
+            if (result.failed()) {
+                ss << result.name << ": " << result.allocationsPerOperation()
+                   << " allocations per operation, expected none" << std::endl;
+                passed = false;
+            }
+        }
+        return passed;
+    }
+
+    void report(std::ostream& ss) const {
+        if (m_options.format == "json") {
+            ss << "[" << std::endl;
+            for (std::size_t i = 0; i < m_results.size(); ++i) {
+                const auto& result = m_results[i];
+                ss << "  {\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations
+                   << ", \"seconds\": " << result.seconds << ", \"ns_per_op\": " << result.nanosPerOperation()
+                   << ", \"ops_per_second\": " << result.operationsPerSecond()
+                   << ", \"allocs_per_op\": " << result.allocationsPerOperation() << "}"
+                   << (i + 1 < m_results.size() ? "," : "") << std::endl;
+            }
+            ss << "]" << std::endl;
+        } else if (m_options.format == "csv") {
+            ss << "name,iterations,seconds,ns_per_op,ops_per_second,allocs_per_op" << std::endl;
+            for (const auto& result : m_results) {
+                ss << result.name << "," << result.iterations << "," << result.seconds << ","
+                   << result.nanosPerOperation() << "," << result.operationsPerSecond() << ","
+                   << result.allocationsPerOperation() << std::endl;
+            }
+        } else {
+            for (const auto& result : m_results) {
+                ss << result.name << ": " << result.nanosPerOperation() << " ns/op, "
+                   << result.operationsPerSecond() << " op/s, "
+                   << result.allocationsPerOperation() << " allocs/op" << std::endl;
+            }
+        }
+    }
+
+private:
+    const BenchmarkOptions m_options;
+    std::vector<BenchmarkResult> m_results;
+};
+
+// Positions reached by random play, a few plies into the game and later.
+std::vector<Board> makeRandomPositions(const int count, Random& random) {
+    std::vector<Board> positions;
+    while (int(positions.size()) < count) {
+        Board game;
+        while (!game.isOver()) {
+            positions.push_back(game);
+            game.makeMove(Board::toCell(game.getRandomAction(random)));
+        }
+    }
+    positions.resize(count);
+    return positions;
+}
+
+void benchmarkBoard(BenchmarkRunner& runner, const std::vector<Board>& positions) {
+    std::size_t index = 0;
+    const auto next = [&]() -> const Board& {
+        index = index + 1 == positions.size() ? 0 : index + 1;
+        return positions[index];
+    };
+
+    runner.run("board/checkWin", [&] { doNotOptimize(next().checkWin(Board::FIRST_PLAYER)); }, true);
+    runner.run("board/isOver", [&] { doNotOptimize(next().isOver()); }, true);
+    runner.run("board/getAvailableActions", [&] { doNotOptimize(next().getAvailableActions()); }, true);
+    runner.run("board/toString", [&] { doNotOptimize(next().toString()); });
+    runner.run("board/getState", [&] { doNotOptimize(next().getState()); }, true);
+}
+
+void benchmarkMinMax(BenchmarkRunner& runner, Random& random) {
+    Board opening;
+    Board middleGame;
+    middleGame.move(QAction{1, 1}, Board::FIRST_PLAYER);
+    middleGame.move(QAction{0, 0}, Board::SECOND_PLAYER);
+    middleGame.move(QAction{2, 1}, Board::FIRST_PLAYER);
+
+    const auto measure = [&](const std::string& name, const Board& game, const char player) {
+        runner.run("minmax/chooseAction/" + name + "/cold", [&] {
+            const MinMaxAgent agent(player, false);
+            doNotOptimize(agent.chooseAction(game, random));
+        });
+        const MinMaxAgent warmAgent(player);
+        runner.run("minmax/chooseAction/" + name + "/warm-tt", [&] {
+            doNotOptimize(warmAgent.chooseAction(game, random));
+        }, true);
+    };
+
+    measure("opening", opening, Board::FIRST_PLAYER);
+    measure("middle", middleGame, Board::SECOND_PLAYER);
+}
+
+void benchmarkMcts(BenchmarkRunner& runner, Random& random) {
+    MctsOptions options;
+    options.playouts = 1000;
+    options.reuseTree = false;
+    const MctsAgent agent(Board::FIRST_PLAYER, options);
+    runner.run("mcts/chooseAction/opening/1000-playouts", [&] {
+        doNotOptimize(agent.chooseAction(Board{}, random));
+    }, true);
+}
+
+// Configurations past 3x3: random games and a short search on each.
+template <typename GameBoard>
+void benchmarkLargeBoard(BenchmarkRunner& runner, const std::string& name, const int minMaxDepth, Random& random) {
+    runner.run("board/" + name + "/random-game", [&] {
+        GameBoard game;
+        while (!game.isOver()) {
+            game.makeMove(GameBoard::toCell(game.getRandomAction(random)));
+        }
+        doNotOptimize(game);
+    }, true);
+
+    MctsOptions options;
+    options.playouts = 200;
+    options.reuseTree = false;
+    const BasicMctsAgent<GameBoard> agent(GameBoard::FIRST_PLAYER, options);
+    runner.run("mcts/chooseAction/" + name + "/200-playouts", [&] {
+        doNotOptimize(agent.chooseAction(GameBoard{}, random));
+    }, true);
+
+    MinMaxOptions minMaxOptions;
+    minMaxOptions.maxDepth = minMaxDepth;
+    minMaxOptions.useTranspositionTable = false;
+    const BasicMinMaxAgent<GameBoard> minMaxAgent(GameBoard::FIRST_PLAYER, minMaxOptions);
+    runner.run("minmax/chooseAction/" + name + "/depth-" + std::to_string(minMaxDepth), [&] {
+        doNotOptimize(minMaxAgent.chooseAction(GameBoard{}, random));
+    }, true);
+
+    // Tasks of the parallel search are heap allocated.
+    minMaxOptions.threadsCount = std::max(2U, std::thread::hardware_concurrency());
+    const BasicMinMaxAgent<GameBoard> parallelAgent(GameBoard::FIRST_PLAYER, minMaxOptions);
+    runner.run("minmax/chooseAction/" + name + "/depth-" + std::to_string(minMaxDepth) + "/parallel", [&] {
+        doNotOptimize(parallelAgent.chooseAction(GameBoard{}, random));
+    });
+}
+
+template <typename QTable>
+void benchmarkQValues(BenchmarkRunner& runner, const std::string& tableName, const std::vector<Board>& positions,
+                      Random& random, const bool allocationFree) {
+    BasicQValuesAgent<QTable> agent;
+    const RandomAgent opponent;
+    EpisodeStats stats;
+    for (int i = 0; i < 5000; ++i) {
+        playLearningEpisodeOfFirstPlayer(agent, opponent, 0.5, random, stats);
+    }
+
+    std::size_t index = 0;
+    const auto next = [&]() -> const Board& {
+        index = index + 1 == positions.size() ? 0 : index + 1;
+        return positions[index];
+    };
+
+    runner.run("qvalues/" + tableName + "/chooseAction", [&] {
+        doNotOptimize(agent.chooseAction(next(), random));
+    }, allocationFree);
+
+    constexpr std::size_t BATCH_SIZE = 64;
+    std::vector<Board> batch(BATCH_SIZE);
+    std::vector<QAction> actions(BATCH_SIZE);
+    runner.run("qvalues/" + tableName + "/chooseActions/64-positions", [&] {
+        for (auto& game : batch) {
+            game = next();
+        }
+        agent.chooseActions(batch.data(), actions.data(), BATCH_SIZE, random);
+        doNotOptimize(actions);
+    }, allocationFree);
+    runner.run("qvalues/" + tableName + "/freeze", [&] {
+        doNotOptimize(FrozenPolicyAgent(agent).getMemorySize());
+    });
+    const FrozenPolicyAgent policy(agent);
+    runner.run("policy/frozen-" + tableName + "/chooseAction", [&] {
+        doNotOptimize(policy.chooseAction(next(), random));
+    }, true);
+
+    runner.run("qvalues/" + tableName + "/updateQValues", [&] {
+        const auto& game = next();
+        const auto action = game.getRandomAction(random);
+        auto nextGame = game;
+        nextGame.move(action, Board::FIRST_PLAYER);
+        agent.updateQValues(game.getState(), nextGame.getState(), action, 0.0, LEARNING_RATE, DISCOUNT_FACTOR);
+    }, allocationFree);
+}
+
+void benchmarkEpisodes(BenchmarkRunner& runner, Random& random) {
+    const RandomAgent randomAgent;
+    const MinMaxAgent minMaxAsSecond(Board::SECOND_PLAYER);
+    const MinMaxAgent minMaxAsFirst(Board::FIRST_PLAYER);
+    EpisodeStats stats;
+
+    // Episodes with the dense table keep all their state inline or in tables
+    // allocated up front, so once warmed up they must not allocate.
+    QValuesAgent firstPlayer;
+    runner.run("episodes/first-player/random", [&] {
+        playLearningEpisodeOfFirstPlayer(firstPlayer, randomAgent, 0.3, random, stats);
+    }, true);
+    runner.run("episodes/first-player/minmax", [&] {
+        playLearningEpisodeOfFirstPlayer(firstPlayer, minMaxAsSecond, 0.3, random, stats);
+    }, true);
+
+    QValuesAgent secondPlayer;
+    runner.run("episodes/second-player/random", [&] {
+        playLearningEpisodeOfSecondPlayer(secondPlayer, randomAgent, 0.3, random, stats);
+    }, true);
+    runner.run("episodes/second-player/minmax", [&] {
+        playLearningEpisodeOfSecondPlayer(secondPlayer, minMaxAsFirst, 0.3, random, stats);
+    }, true);
+
+    MapQValuesAgent mapFirstPlayer(false);
+    runner.run("episodes/first-player/random/map-qtable", [&] {
+        playLearningEpisodeOfFirstPlayer(mapFirstPlayer, randomAgent, 0.3, random, stats);
+    });
+
+    // Multi-step rules keep the steps of an episode in a fixed list, so they don't allocate either.
+    const auto measure = [&](const std::string& name, const UpdateRule rule) {
+        QValuesAgent agent;
+        UpdateRuleOptions options;
+        options.rule = rule;
+        EpisodeLearner<DenseQTable> learn(agent, options, LEARNING_RATE, DISCOUNT_FACTOR, stats);
+        runner.run("episodes/first-player/random/" + name, [&] {
+            playEpisodeOfFirstPlayer(agent, randomAgent, 0.3, random, stats, false, learn);
+        }, true);
+    };
+    measure("n-step", UpdateRule::NStep);
+    measure("replacing-traces", UpdateRule::ReplacingTraces);
+}
+
+void benchmarkReplay(BenchmarkRunner& runner, Random& random) {
+    const RandomAgent randomAgent;
+    EpisodeStats stats;
+    constexpr std::size_t REPLAYS = 1024;
+
+    const auto measure = [&](const std::string& name, const ReplayOptions& options) {
+        QValuesAgent agent;
+        ReplayBuffer buffer(options);
+        while (buffer.size() < buffer.capacity()) {
+            playEpisodeOfFirstPlayer(agent, randomAgent, 0.3, random, stats, false,
+                                     [&](const Board::State state, const Board::State nextState, const QAction& action,
+                                         const double reward) {
+                                         buffer.add(Transition{state, nextState, std::int8_t(Board::toCell(action)),
+                                                               float(reward)});
+                                     });
+        }
+        std::vector<std::uint64_t> samples;
+        runner.run("replay/1024-transitions/" + name, [&] {
+            replayTransitions(agent, buffer, REPLAYS, options.sortByState, samples, random, stats);
+        }, true);
+    };
+
+    ReplayOptions options;
+    measure("uniform", options);
+    options.sortByState = true;
+    measure("uniform/sorted", options);
+    options.prioritized = true;
+    measure("prioritized/sorted", options);
+}
+
+// Inference and minibatch SGD of a network agent, on positions and transitions
+// from games with random moves. Kernels are AVX2 ones when the build enables them.
+template <typename NetworkAgent>
+void benchmarkNetwork(BenchmarkRunner& runner, const std::string& name, Random& random) {
+    using GameBoard = typename NetworkAgent::BoardType;
+    constexpr std::size_t BATCH_SIZE = 64;
+    constexpr std::size_t TRANSITIONS_COUNT = 32;
+
+    NetworkAgent agent;
+    const BasicRandomAgent<GameBoard> opponent;
+    EpisodeStats stats;
+    std::vector<GameBoard> positions;
+    std::vector<typename NetworkAgent::Transition> transitions;
+    while (transitions.size() < TRANSITIONS_COUNT) {
+        playNetworkEpisode(agent, opponent, GameBoard::FIRST_PLAYER, 1.0, random, stats,
+                           [&](const typename NetworkAgent::Transition& transition) {
+                               transitions.push_back(transition);
+                               positions.push_back(GameBoard::fromMasks(transition.first, transition.second));
+                           });
+    }
+    positions.resize(BATCH_SIZE, GameBoard{});
+
+    std::size_t index = 0;
+    runner.run("network/" + name + "/chooseAction", [&] {
+        index = index + 1 == positions.size() ? 0 : index + 1;
+        doNotOptimize(agent.chooseAction(positions[index], random));
+    }, true);
+
+    std::vector<QAction> actions(BATCH_SIZE);
+    runner.run("network/" + name + "/chooseActions/64-positions", [&] {
+        agent.chooseActions(positions.data(), actions.data(), BATCH_SIZE, random);
+        doNotOptimize(actions);
+    }, true);
+
+    runner.run("network/" + name + "/learn/32-transitions", [&] {
+        doNotOptimize(agent.learn(transitions.data(), TRANSITIONS_COUNT, 0.001, DISCOUNT_FACTOR));
+    }, true);
+}
+
+// Startup of a checkpoint served by its stored policy, up to the first move,
+// against the checksum pass of the same file.
+void benchmarkCheckpoint(BenchmarkRunner& runner, Random& random) {
+    const auto path = (std::filesystem::temp_directory_path() / "tictactoe-benchmark.checkpoint").string();
+    QValuesAgent agent;
+    const RandomAgent opponent;
+    EpisodeStats stats;
+    for (int i = 0; i < 5000; ++i) {
+        playLearningEpisodeOfFirstPlayer(agent, opponent, 0.5, random, stats);
+    }
+    if (saveCheckpoint(path, agent, Board::FIRST_PLAYER)) {
+        runner.run("checkpoint/load-policy/first-move", [&] {
+            const FrozenPolicyAgent policy(std::move(*MappedQTable::load(path, false)));
+            doNotOptimize(policy.chooseAction(Board{}, random));
+        });
+        runner.run("checkpoint/load/verify-checksum", [&] {
+            doNotOptimize(MappedQTable::load(path)->size());
+        });
+    }
+    std::remove(path.c_str());
+}
+
+// Replay of recorded random games from a log mapped in memory, once to only
+// walk the transitions and once into a Q-table.
+void benchmarkTrajectories(BenchmarkRunner& runner) {
+    constexpr int GAMES = 4096;
+    const auto path = (std::filesystem::temp_directory_path() / "tictactoe-benchmark.trajectories").string();
+    const RandomAgent randomAgent;
+    ThreadPool pool(1);
+    runner.run("trajectories/4096-games/record", [&] {
+        TrajectoryRecorder recorder(path);
+        recordGames(randomAgent, randomAgent, GAMES, 1, pool, recorder);
+        doNotOptimize(recorder.close());
+    });
+
+    const auto log = TrajectoryLog::open(path);
+    if (log) {
+        runner.run("trajectories/4096-games/transitions", [&] {
+            double rewards = 0;
+            for (const auto& record : *log) {
+                forEachTransition(record, Board::FIRST_PLAYER, [&](const Board::State, const Board::State,
+                                                                  const QAction&, const double reward) {
+                    rewards += reward;
+                });
+            }
+            doNotOptimize(rewards);
+        }, true);
+
+        QValuesAgent agent;
+        runner.run("trajectories/4096-games/updateQValues", [&] {
+            for (const auto& record : *log) {
+                forEachTransition(record, Board::FIRST_PLAYER, [&](const Board::State state, const Board::State nextState,
+                                                                  const QAction& action, const double reward) {
+                    agent.updateQValues(state, nextState, action, reward, LEARNING_RATE, DISCOUNT_FACTOR);
+                });
+            }
+        }, true);
+    }
+    std::remove(path.c_str());
+}
+
+void benchmarkEvaluation(BenchmarkRunner& runner) {
+    const RandomAgent randomAgent;
+    ThreadPool pool(1);
+    constexpr int GAMES = 1024;
+    runner.run("evaluation/1024-games/per-board", [&] {
+        doNotOptimize(evaluateAgent(Board::FIRST_PLAYER, randomAgent, randomAgent, GAMES, 1, pool));
+    });
+    const Agent& virtualAgent = randomAgent;
+    runner.run("evaluation/1024-games/per-board/virtual", [&] {
+        doNotOptimize(evaluateAgent(Board::FIRST_PLAYER, virtualAgent, virtualAgent, GAMES, 1, pool));
+    });
+    runner.run("evaluation/1024-games/batched", [&] {
+        doNotOptimize(evaluatePoliciesBatched(Board::FIRST_PLAYER, RandomBatchPolicy{}, RandomBatchPolicy{},
+                                              GAMES, 1, pool));
+    });
+    runner.run("evaluation/1024-games/batched/agents", [&] {
+        doNotOptimize(evaluateAgentBatched(Board::FIRST_PLAYER, randomAgent, randomAgent, GAMES, 1, pool));
+    });
+
+    // Six ordered pairings of 1024 / 6 games each, with every move timed.
+    const MinMaxAgent minMaxAsFirst(Board::FIRST_PLAYER);
+    const MinMaxAgent minMaxAsSecond(Board::SECOND_PLAYER);
+    const RandomAgent otherRandomAgent;
+    const std::vector<TournamentEntry> entries = {{"random", &randomAgent, &randomAgent},
+                                                  {"random-2", &otherRandomAgent, &otherRandomAgent},
+                                                  {"minmax", &minMaxAsFirst, &minMaxAsSecond}};
+    TournamentOptions tournamentOptions;
+    tournamentOptions.gamesPerSeat = GAMES / 6;
+    runner.run("tournament/3-entries/1020-games", [&] {
+        doNotOptimize(playTournament(entries, tournamentOptions, pool).ratings);
+    });
+}
+
+bool parseOptions(const int argc, char* argv[], BenchmarkOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (i + 1 == argc) {
+            std::cout << "Missing value of " << option << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        if (option == "--format" && (value == "text" || value == "json" || value == "csv")) {
+            options.format = value;
+        } else if (option == "--output") {
+            options.output = value;
+        } else if (option == "--filter") {
+            options.filter = value;
+        } else if (option == "--min-time") {
+            options.minSeconds = std::stod(value);
+        } else {
+            std::cout << "Unknown option " << option << " " << value << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cout << "Usage: " << argv[0] << " [--format text|json|csv] [--output FILE]"
+                  << " [--filter SUBSTRING] [--min-time SECONDS]" << std::endl;
+        return -1;
+    }
+
+    Random random;
+    const auto positions = makeRandomPositions(4096, random);
+
+    BenchmarkRunner runner(options);
+    benchmarkBoard(runner, positions);
+    benchmarkMinMax(runner, random);
+    benchmarkMcts(runner, random);
+    benchmarkLargeBoard<BasicBoard<4, 4>>(runner, "4x4", 5, random);
+    benchmarkLargeBoard<BasicBoard<15, 5>>(runner, "15x15-5", 3, random);
+    benchmarkQValues<DenseQTable>(runner, "dense", positions, random, true);
+    benchmarkQValues<MapQTable>(runner, "map", positions, random, false);
+    benchmarkCheckpoint(runner, random);
+    benchmarkEpisodes(runner, random);
+    benchmarkReplay(runner, random);
+    benchmarkNetwork<LinearAgent>(runner, "linear/3x3", random);
+    benchmarkNetwork<MlpAgent>(runner, "mlp-64/3x3", random);
+    benchmarkNetwork<BasicNetworkAgent<BasicBoard<15, 5>, 64>>(runner, "mlp-64/15x15-5", random);
+    benchmarkTrajectories(runner);
+    benchmarkEvaluation(runner);
+
+    if (options.output.empty()) {
+        runner.report(std::cout);
+    } else {
+        std::ofstream output(options.output);
+        runner.report(output);
+    }
+
+    return runner.checkAllocations(std::cout) ? 0 : 1;
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <fstream>
+#include <vector>
+#include <string>
+#include <optional>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(_WIN32)
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "game.h"
+
+// Binary Q-table checkpoint:
+//   CheckpointHeader (64 bytes)
+//   known actions:  STATES_COUNT x uint16, padded to 8 bytes
+//   values:         STATES_COUNT x CELLS_COUNT x double, row per Board::State
+//   best actions:   STATES_COUNT x uint16, padded to 8 bytes (since version 2)
+// Blocks are stored in host byte order and aligned so they can be used in place
+// from a memory mapping; the checksum is FNV-1a over all blocks. Best actions
+// are the greedy policy of FrozenPolicyAgent, so serving it computes nothing.
+struct CheckpointHeader {
+    constexpr static const char MAGIC[8] = {'T', 'T', 'T', 'Q', 'T', 'A', 'B', '\0'};
+    constexpr static const std::uint32_t VERSION = 2;
+    // Version 1 files, without best actions, are still read.
+    constexpr static const std::uint32_t FIRST_VERSION = 1;
+    // Board::State as a base-3 number, cell 0 being the least significant digit.
+    constexpr static const std::uint32_t TERNARY_ENCODING = 1;
+    constexpr static const std::uint32_t SYMMETRIC_FLAG = 1;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t stateEncoding;
+    std::uint32_t statesCount;
+    std::uint32_t actionsCount;
+    std::uint32_t flags;
+    char player;
+    char reserved[3];
+    // States with at least one known action, as the tables count their size().
+    std::uint64_t learnedStates;
+    std::uint64_t knownOffset;
+    std::uint64_t valuesOffset;
+    std::uint64_t checksum;
+
+    constexpr static std::uint64_t knownBlockSize() {
+        return (Board::STATES_COUNT * sizeof(Board::Mask) + 7) / 8 * 8;
+    }
+
+    constexpr static std::uint64_t valuesBlockSize() {
+        return std::uint64_t(Board::STATES_COUNT) * Board::CELLS_COUNT * sizeof(QValue);
+    }
+
+    constexpr static std::uint64_t bestActionsBlockSize() {
+        return knownBlockSize();
+    }
+
+    constexpr static std::uint64_t bestActionsOffset() {
+        return sizeof(CheckpointHeader) + knownBlockSize() + valuesBlockSize();
+    }
+
+    constexpr static std::uint64_t fileSize(const std::uint32_t version = VERSION) {
+        return bestActionsOffset() + (version >= 2 ? bestActionsBlockSize() : 0);
+    }
+};
+
+static_assert(sizeof(CheckpointHeader) == 64, "checkpoint header layout changed");
+
+// FNV-1a; pass the checksum of the preceding bytes as hash to continue it.
+inline std::uint64_t checkpointChecksum(const char* data, const std::size_t size,
+                                        std::uint64_t hash = 0xCBF29CE484222325ULL) {
+    for (std::size_t i = 0; i < size; ++i) {
+        hash = (hash ^ std::uint8_t(data[i])) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// Writes the agent's table, learned for player, and its greedy policy in the checkpoint format.
+template <typename Agent>
+bool saveCheckpoint(const std::string& path, const Agent& agent, const char player) {
+    std::vector<char> payload(CheckpointHeader::fileSize() - sizeof(CheckpointHeader), 0);
+    auto* known = reinterpret_cast<Board::Mask*>(payload.data());
+    auto* values = reinterpret_cast<QValue*>(payload.data() + CheckpointHeader::knownBlockSize());
+    auto* bestActions = reinterpret_cast<Board::Mask*>(payload.data() + CheckpointHeader::bestActionsOffset()
+                                                       - sizeof(CheckpointHeader));
+    agent.getTable().forEach([&](const Board::State state, const int cell, const QValue value) {
+        known[state] |= Board::Mask(1 << cell);
+        values[std::size_t(state) * Board::CELLS_COUNT + cell] = value;
+    });
+    std::uint64_t learnedStates = 0;
+    for (int state = 0; state < Board::STATES_COUNT; ++state) {
+        bestActions[state] = agent.getBestActions(Board::fromState(Board::State(state)));
+        learnedStates += known[state] != 0;
+    }
+
+    CheckpointHeader header{};
+    std::memcpy(header.magic, CheckpointHeader::MAGIC, sizeof(header.magic));
+    header.version = CheckpointHeader::VERSION;
+    header.stateEncoding = CheckpointHeader::TERNARY_ENCODING;
+    header.statesCount = Board::STATES_COUNT;
+    header.actionsCount = Board::CELLS_COUNT;
+    header.flags = agent.isSymmetric() ? CheckpointHeader::SYMMETRIC_FLAG : 0;
+    header.player = player;
+    header.learnedStates = learnedStates;
+    header.knownOffset = sizeof(CheckpointHeader);
+    header.valuesOffset = sizeof(CheckpointHeader) + CheckpointHeader::knownBlockSize();
+    header.checksum = checkpointChecksum(payload.data(), payload.size());
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(payload.data(), std::streamsize(payload.size()));
+    return bool(file);
+}
+
+// Read-only memory mapping of a whole file; files are read into memory where
+// mapping is not available. The data stays in place when the object is moved.
+class MappedFile final {
+public:
+    static std::optional<MappedFile> open(const std::string& path) {
+        MappedFile file;
+        if (!file.map(path)) {
+            return std::nullopt;
+        }
+        return file;
+    }
+
+    MappedFile(MappedFile&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+#if defined(_WIN32)
+        std::swap(m_buffer, other.m_buffer);
+#endif
+        return *this;
+    }
+
+    ~MappedFile() {
+#if !defined(_WIN32)
+        if (m_data) {
+            munmap(const_cast<char*>(m_data), m_size);
+        }
+#endif
+    }
+
+    const char* data() const {
+        return m_data;
+    }
+
+    std::size_t size() const {
+        return m_size;
+    }
+
+private:
+    MappedFile() = default;
+
+    bool map(const std::string& path) {
+#if defined(_WIN32)
+        std::ifstream file(path, std::ios::binary);
+        m_buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+        return bool(file) || file.eof();
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat status;
+        if (fstat(fd, &status) != 0 || status.st_size <= 0) {
+            close(fd);
+            return false;
+        }
+        void* data = mmap(nullptr, std::size_t(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        m_data = static_cast<const char*>(data);
+        m_size = std::size_t(status.st_size);
+        return true;
+#endif
+    }
+
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+#if defined(_WIN32)
+    std::vector<char> m_buffer;
+#endif
+};
+
+// Read-only Q-table served straight from a memory-mapped checkpoint,
+// usable as the table of BasicQValuesAgent for playing (not for learning).
+class MappedQTable final {
+public:
+    constexpr static const bool CONCURRENT = false;
+
+    // Maps the file and validates its header; the checksum pass reads the
+    // whole file, so it can be skipped when startup latency matters.
+    static std::optional<MappedQTable> load(const std::string& path, const bool verifyChecksum = true) {
+        auto file = MappedFile::open(path);
+        if (!file || file->size() < sizeof(CheckpointHeader)) {
+            return std::nullopt;
+        }
+        MappedQTable table(std::move(*file));
+
+        const auto& header = table.getHeader();
+        if (std::memcmp(header.magic, CheckpointHeader::MAGIC, sizeof(header.magic)) != 0
+            || header.version < CheckpointHeader::FIRST_VERSION || header.version > CheckpointHeader::VERSION
+            || table.m_file.size() < CheckpointHeader::fileSize(header.version)
+            || header.stateEncoding != CheckpointHeader::TERNARY_ENCODING
+            || header.statesCount != Board::STATES_COUNT
+            || header.actionsCount != Board::CELLS_COUNT
+            || header.knownOffset != sizeof(CheckpointHeader)
+            || header.valuesOffset != sizeof(CheckpointHeader) + CheckpointHeader::knownBlockSize()) {
+            return std::nullopt;
+        }
+        if (verifyChecksum
+            && checkpointChecksum(table.m_file.data() + header.knownOffset,
+                                  CheckpointHeader::fileSize(header.version) - header.knownOffset) != header.checksum) {
+            return std::nullopt;
+        }
+
+        table.m_known = reinterpret_cast<const Board::Mask*>(table.m_file.data() + header.knownOffset);
+        table.m_values = reinterpret_cast<const QValue*>(table.m_file.data() + header.valuesOffset);
+        if (header.version >= 2) {
+            table.m_bestActions =
+                reinterpret_cast<const Board::Mask*>(table.m_file.data() + CheckpointHeader::bestActionsOffset());
+        }
+        return table;
+    }
+
+    MappedQTable(MappedQTable&& other) noexcept
+        : m_file(std::move(other.m_file))
+        , m_known(std::exchange(other.m_known, nullptr))
+        , m_values(std::exchange(other.m_values, nullptr))
+        , m_bestActions(std::exchange(other.m_bestActions, nullptr)) {}
+
+    MappedQTable& operator=(MappedQTable&& other) noexcept {
+        std::swap(m_file, other.m_file);
+        std::swap(m_known, other.m_known);
+        std::swap(m_values, other.m_values);
+        std::swap(m_bestActions, other.m_bestActions);
+        return *this;
+    }
+
+    const CheckpointHeader& getHeader() const {
+        return *reinterpret_cast<const CheckpointHeader*>(m_file.data());
+    }
+
+    bool isSymmetric() const {
+        return getHeader().flags & CheckpointHeader::SYMMETRIC_FLAG;
+    }
+
+    char getPlayer() const {
+        return getHeader().player;
+    }
+
+    // Masked to the cells of the board: without the checksum pass the file is
+    // not known to be intact, and values are only read for these cells.
+    Board::Mask getKnownActions(const Board::State state) const {
+        return state < Board::STATES_COUNT ? Board::Mask(m_known[state] & Board::FULL_MASK) : 0;
+    }
+
+    QValue getValue(const Board::State state, const int cell) const {
+        return m_values[std::size_t(state) * Board::CELLS_COUNT + cell];
+    }
+
+    QValue getMaxValue(const Board::State state) const {
+        if (state >= Board::STATES_COUNT) {
+            return 0;
+        }
+        const auto* row = m_values + std::size_t(state) * Board::CELLS_COUNT;
+        return std::max(QValue(0), *std::max_element(row, row + Board::CELLS_COUNT));
+    }
+
+    void prefetch(const Board::State state) const {
+        if (state < Board::STATES_COUNT) {
+            prefetchMemory(m_known + state);
+            prefetchMemory(m_values + std::size_t(state) * Board::CELLS_COUNT);
+        }
+    }
+
+    std::size_t size() const {
+        return std::size_t(getHeader().learnedStates);
+    }
+
+    // The best actions block, STATES_COUNT masks, or nullptr in version 1 files.
+    // Like the known actions, masks are not checked against the board.
+    const Board::Mask* getBestActionsBlock() const {
+        return m_bestActions;
+    }
+
+    template <typename Visitor>
+    void forEach(Visitor&& visitor) const {
+        for (int state = 0; state < Board::STATES_COUNT; ++state) {
+            for (auto known = getKnownActions(Board::State(state)); known; known &= known - 1) {
+                const auto cell = Board::lowestCell(known);
+                visitor(Board::State(state), cell, getValue(Board::State(state), cell));
+            }
+        }
+    }
+
+private:
+    explicit MappedQTable(MappedFile&& file) : m_file(std::move(file)) {}
+
+    MappedFile m_file;
+    const Board::Mask* m_known = nullptr;
+    const QValue* m_values = nullptr;
+    const Board::Mask* m_bestActions = nullptr;
+};
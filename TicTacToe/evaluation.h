@@ -0,0 +1,166 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+#include "game.h"
+#include "agent.h"
+#include "random.h"
+#include "thread_pool.h"
+#include "batch_game.h"
+
+// Wilson score interval of a binomial proportion.
+struct ConfidenceInterval {
+    double low = 0;
+    double high = 0;
+
+    static ConfidenceInterval wilson(const int successes, const int trials, const double z = 1.96) {
+        if (trials == 0) {
+            return {};
+        }
+        const double n = trials;
+        const double p = successes / n;
+        const double denominator = 1 + z * z / n;
+        const double center = (p + z * z / (2 * n)) / denominator;
+        const double spread = z * std::sqrt(p * (1 - p) / n + z * z / (4 * n * n)) / denominator;
+        return {center - spread, center + spread};
+    }
+};
+
+struct EvaluationResult {
+    int games = 0;
+    int wins = 0;
+    int draws = 0;
+    int losses = 0;
+    double seconds = 0;
+
+    EvaluationResult& operator+=(const EvaluationResult& other) {
+        games += other.games;
+        wins += other.wins;
+        draws += other.draws;
+        losses += other.losses;
+        return *this;
+    }
+
+    double gamesPerSecond() const {
+        return seconds > 0 ? games / seconds : 0;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& ss, const EvaluationResult& result) {
+    const auto printRate = [&](const char* name, const int count) {
+        const auto interval = ConfidenceInterval::wilson(count, result.games);
+        ss << name << ": " << double(count) / result.games
+           << " [" << interval.low << ", " << interval.high << "]" << std::endl;
+    };
+    printRate("WinRate", result.wins);
+    printRate("WinRate(+Draws)", result.wins + result.draws);
+    printRate("DrawRate", result.draws);
+    printRate("LossRate", result.losses);
+    ss << "Games: " << result.games << " in " << result.seconds << " s ("
+       << result.gamesPerSecond() << " games/s)" << std::endl;
+    return ss;
+}
+
+// Plays one game from the empty board and scores it for targetPlayer.
+// Agents are called through their static types, see agent.h.
+template <typename AiAgent, typename Opponent>
+EvaluationResult playEvaluationGame(const char targetPlayer, const AiAgent& aiAgent, const Opponent& opponent,
+                                    Random& random) {
+    typename AiAgent::BoardType game;
+    char currentPlayer = Board::FIRST_PLAYER;
+    while (!game.isOver()) {
+        const auto action = currentPlayer == targetPlayer ? aiAgent.chooseAction(game, random)
+                                                          : opponent.chooseAction(game, random);
+        game.move(action, currentPlayer);
+        currentPlayer = getOponent(currentPlayer); // Switch players
+    }
+
+    EvaluationResult result;
+    result.games = 1;
+    if (game.checkWin(targetPlayer)) {
+        result.wins = 1;
+    } else if (game.checkWin(getOponent(targetPlayer))) {
+        result.losses = 1;
+    } else {
+        result.draws = 1;
+    }
+    return result;
+}
+
+// Games are split into fixed shards, each replayed with its own random stream
+// of seed numbered by the shard, so the result depends on the seed
+// only and not on how many threads the pool has.
+template <typename AiAgent, typename Opponent>
+EvaluationResult evaluateAgent(const char targetPlayer, const AiAgent& aiAgent, const Opponent& opponent,
+                               const int gamesCount, const std::uint64_t seed, ThreadPool& pool) {
+    constexpr int SHARD_SIZE = 256;
+    const auto shardsCount = (gamesCount + SHARD_SIZE - 1) / SHARD_SIZE;
+    std::vector<EvaluationResult> shards(shardsCount);
+
+    const auto start = std::chrono::steady_clock::now();
+    pool.parallelFor(shardsCount, [&](const std::size_t shard) {
+        Random random(seed, shard);
+        const auto first = int(shard) * SHARD_SIZE;
+        const auto last = std::min(first + SHARD_SIZE, gamesCount);
+        for (int i = first; i < last; ++i) {
+            shards[shard] += playEvaluationGame(targetPlayer, aiAgent, opponent, random);
+        }
+    });
+
+    EvaluationResult result;
+    for (const auto& shard : shards) {
+        result += shard;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Same sharding as evaluateAgent(), but every shard is one BoardBatch played
+// in lockstep with the given batch policies (see batch_game.h).
+template <typename AiPolicy, typename OpponentPolicy>
+EvaluationResult evaluatePoliciesBatched(const char targetPlayer, const AiPolicy& aiPolicy, const OpponentPolicy& opponentPolicy,
+                                         const int gamesCount, const std::uint64_t seed, ThreadPool& pool) {
+    constexpr int SHARD_SIZE = 256;
+    const auto shardsCount = (gamesCount + SHARD_SIZE - 1) / SHARD_SIZE;
+    std::vector<EvaluationResult> shards(shardsCount);
+
+    const auto start = std::chrono::steady_clock::now();
+    pool.parallelFor(shardsCount, [&](const std::size_t shard) {
+        Random random(seed, shard);
+        const auto first = int(shard) * SHARD_SIZE;
+        BoardBatch batch(std::size_t(std::min(first + SHARD_SIZE, gamesCount) - first));
+        if (targetPlayer == Board::FIRST_PLAYER) {
+            playBatch(batch, aiPolicy, opponentPolicy, random);
+        } else {
+            playBatch(batch, opponentPolicy, aiPolicy, random);
+        }
+
+        const auto won = targetPlayer == Board::FIRST_PLAYER ? BoardBatch::FIRST_PLAYER_WON : BoardBatch::SECOND_PLAYER_WON;
+        auto& result = shards[shard];
+        result.games = int(batch.size());
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            const auto status = batch.getStatus(i);
+            result.wins += status == won;
+            result.draws += status == BoardBatch::DRAW;
+        }
+        result.losses = result.games - result.wins - result.draws;
+    });
+
+    EvaluationResult result;
+    for (const auto& shard : shards) {
+        result += shard;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+template <typename AiAgent, typename Opponent>
+EvaluationResult evaluateAgentBatched(const char targetPlayer, const AiAgent& aiAgent, const Opponent& opponent,
+                                      const int gamesCount, const std::uint64_t seed, ThreadPool& pool) {
+    return evaluatePoliciesBatched(targetPlayer, AgentBatchPolicy<AiAgent>{aiAgent}, AgentBatchPolicy<Opponent>{opponent},
+                                   gamesCount, seed, pool);
+}
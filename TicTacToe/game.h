@@ -1,49 +1,450 @@
 #pragma once
 
 #include <iostream>
-#include <vector>
-#include <unordered_map>
+#include <array>
+#include <cstdint>
 #include <ctime>
 #include <cstdlib>
 #include <limits>
 #include <sstream>
+#include <type_traits>
+
+#include "random.h"
 
 using QValue = double;
 using QAction = std::pair<int, int>;
-using QActionList = std::vector<QAction>;
 
-class Board final {
+// Vector-like list with inline storage for the few elements a position has
+// (moves, cells), so building one never touches the heap.
+template <typename T, std::size_t Capacity>
+class FixedList final {
+public:
+    constexpr void push_back(const T& value) {
+        m_items[m_size++] = value;
+    }
+
+    constexpr void clear() {
+        m_size = 0;
+    }
+
+    constexpr std::size_t size() const {
+        return m_size;
+    }
+
+    constexpr bool empty() const {
+        return m_size == 0;
+    }
+
+    constexpr T& operator[](const std::size_t index) {
+        return m_items[index];
+    }
+
+    constexpr const T& operator[](const std::size_t index) const {
+        return m_items[index];
+    }
+
+    constexpr T* begin() {
+        return m_items.data();
+    }
+
+    constexpr T* end() {
+        return m_items.data() + m_size;
+    }
+
+    constexpr const T* begin() const {
+        return m_items.data();
+    }
+
+    constexpr const T* end() const {
+        return m_items.data() + m_size;
+    }
+
+private:
+    std::array<T, Capacity> m_items{};
+    std::size_t m_size = 0;
+};
+
+inline int lowestBit(const std::uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#else
+    int bit = 0;
+    while (!(bits & (std::uint64_t(1) << bit))) {
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+inline int bitsCount(const std::uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(bits);
+#else
+    int count = 0;
+    for (auto rest = bits; rest; rest &= rest - 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// Hint that the memory is read soon.
+inline void prefetchMemory(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+}
+
+// Set of more cells than fit in a machine word, with the operators boards apply to masks.
+template <int Words>
+struct WideMask {
+    std::array<std::uint64_t, Words> words{};
+
+    constexpr WideMask& operator&=(const WideMask& other) {
+        for (int i = 0; i < Words; ++i) words[i] &= other.words[i];
+        return *this;
+    }
+
+    constexpr WideMask& operator|=(const WideMask& other) {
+        for (int i = 0; i < Words; ++i) words[i] |= other.words[i];
+        return *this;
+    }
+
+    constexpr WideMask& operator^=(const WideMask& other) {
+        for (int i = 0; i < Words; ++i) words[i] ^= other.words[i];
+        return *this;
+    }
+
+    constexpr WideMask operator&(const WideMask& other) const {
+        auto mask = *this;
+        return mask &= other;
+    }
+
+    constexpr WideMask operator|(const WideMask& other) const {
+        auto mask = *this;
+        return mask |= other;
+    }
+
+    constexpr WideMask operator^(const WideMask& other) const {
+        auto mask = *this;
+        return mask ^= other;
+    }
+
+    constexpr WideMask operator~() const {
+        WideMask mask;
+        for (int i = 0; i < Words; ++i) mask.words[i] = ~words[i];
+        return mask;
+    }
+
+    constexpr bool operator==(const WideMask& other) const {
+        for (int i = 0; i < Words; ++i) {
+            if (words[i] != other.words[i]) return false;
+        }
+        return true;
+    }
+
+    constexpr bool operator!=(const WideMask& other) const {
+        return !(*this == other);
+    }
+
+    constexpr explicit operator bool() const {
+        for (const auto word : words) {
+            if (word) return true;
+        }
+        return false;
+    }
+};
+
+// The smallest unsigned type with a bit per cell, a WideMask beyond 64 cells.
+template <int Cells>
+using CellMask = std::conditional_t<(Cells <= 16), std::uint16_t,
+                 std::conditional_t<(Cells <= 32), std::uint32_t,
+                 std::conditional_t<(Cells <= 64), std::uint64_t, WideMask<(Cells + 63) / 64>>>>;
+
+template <typename Mask>
+constexpr Mask cellMask(const int cell) {
+    if constexpr (std::is_integral_v<Mask>) {
+        return Mask(Mask(1) << cell);
+    } else {
+        Mask mask;
+        mask.words[cell / 64] = std::uint64_t(1) << (cell % 64);
+        return mask;
+    }
+}
+
+template <typename Mask>
+constexpr Mask makeFullMask(const int cells) {
+    Mask mask{};
+    for (int cell = 0; cell < cells; ++cell) {
+        mask |= cellMask<Mask>(cell);
+    }
+    return mask;
+}
+
+constexpr int winLinesCount(const int size, const int winLength) {
+    return 2 * size * (size - winLength + 1) + 2 * (size - winLength + 1) * (size - winLength + 1);
+}
+
+constexpr int powerOfThree(const int exponent) {
+    return exponent == 0 ? 1 : 3 * powerOfThree(exponent - 1);
+}
+
+// Calls visitor(line, cell) for every cell of every WinLength cells in a row: rows,
+// then columns, diagonals and anti-diagonals, each in order of their first cell.
+template <int Size, int WinLength, typename Visitor>
+constexpr void forEachLineCell(Visitor&& visitor) {
+    const int directions[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+    int line = 0;
+    for (const auto& direction : directions) {
+        for (int row = 0; row < Size; ++row) {
+            for (int col = 0; col < Size; ++col) {
+                const int lastRow = row + direction[0] * (WinLength - 1);
+                const int lastCol = col + direction[1] * (WinLength - 1);
+                if (lastRow >= Size || lastCol < 0 || lastCol >= Size) {
+                    continue;
+                }
+                for (int i = 0; i < WinLength; ++i) {
+                    visitor(line, (row + direction[0] * i) * Size + col + direction[1] * i);
+                }
+                ++line;
+            }
+        }
+    }
+}
+
+// Cell (row, col) is bit row * Size + col.
+template <int Size, int WinLength, typename Mask>
+constexpr std::array<Mask, winLinesCount(Size, WinLength)> makeWinMasks() {
+    std::array<Mask, winLinesCount(Size, WinLength)> masks{};
+    forEachLineCell<Size, WinLength>([&](const int line, const int cell) {
+        masks[line] |= cellMask<Mask>(cell);
+    });
+    return masks;
+}
+
+// Indices of the lines through every cell; a cell lies on at most WinLength lines per direction.
+template <int Size, int WinLength>
+constexpr std::array<FixedList<std::uint16_t, 4 * WinLength>, Size * Size> makeCellLines() {
+    std::array<FixedList<std::uint16_t, 4 * WinLength>, Size * Size> lines{};
+    forEachLineCell<Size, WinLength>([&](const int line, const int cell) {
+        lines[cell].push_back(std::uint16_t(line));
+    });
+    return lines;
+}
+
+// Base-3 value of every cell subset: bit i of the mask contributes 3^i.
+template <int Cells, typename State>
+constexpr std::array<State, (1 << Cells)> makeTernaryDigits() {
+    std::array<State, (1 << Cells)> digits{};
+    State power = 1;
+    for (int cell = 0; cell < Cells; ++cell, power *= 3) {
+        // Subsets with cell as their highest one extend the subsets of the lower cells.
+        for (int mask = 0; mask < (1 << cell); ++mask) {
+            digits[(1 << cell) | mask] = State(digits[mask] + power);
+        }
+    }
+    return digits;
+}
+
+// Zobrist keys: ZOBRIST_KEYS[player][cell] with player 0 for the first and 1 for the second player.
+template <int Cells>
+constexpr std::array<std::array<std::uint64_t, Cells>, 2> makeZobristKeys(std::uint64_t seed) {
+    std::array<std::array<std::uint64_t, Cells>, 2> keys{};
+    for (auto& playerKeys : keys) {
+        for (auto& key : playerKeys) {
+            // splitmix64
+            seed += 0x9E3779B97F4A7C15ULL;
+            std::uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            key = z ^ (z >> 31);
+        }
+    }
+    return keys;
+}
+
+// Board of Size x Size cells won with WinLength pieces in a row, column or
+// diagonal. Masks are the narrowest type with a bit per cell, and line
+// tables and loop bounds are compile-time constants of the configuration.
+// Positions have a base-3 State only up to 16 cells.
+template <int Size, int WinLength = Size>
+class BasicBoard final {
 public:
-    constexpr static const int BOARD_SIZE = 3;
+    constexpr static const int BOARD_SIZE = Size;
+    constexpr static const int WIN_LENGTH = WinLength;
+    constexpr static const int CELLS_COUNT = BOARD_SIZE * BOARD_SIZE;
+    constexpr static const int LINES_COUNT = winLinesCount(BOARD_SIZE, WIN_LENGTH);
+    constexpr static const bool HAS_STATE = CELLS_COUNT <= 16;
+
+    using Mask = CellMask<CELLS_COUNT>;
+    // Base-3 index of the position: empty, first and second player are digits 0, 1 and 2.
+    using State = std::conditional_t<(CELLS_COUNT <= 10), std::uint16_t, std::uint32_t>;
+
+    constexpr static const Mask FULL_MASK = makeFullMask<Mask>(CELLS_COUNT);
+    constexpr static const int STATES_COUNT = HAS_STATE ? powerOfThree(CELLS_COUNT) : 0;
+    // Stands for "no successor" when a terminal transition is learned.
+    constexpr static const State NO_STATE = State(STATES_COUNT);
     constexpr static const char EMPTY_CELL = '-';
     constexpr static const char SECOND_PLAYER = 'O';
     constexpr static const char FIRST_PLAYER = 'X';
 
-    Board() : m_board(BOARD_SIZE, std::vector<char>(BOARD_SIZE, EMPTY_CELL)) {
+    using LineMasks = std::array<Mask, LINES_COUNT>;
+    using ActionList = FixedList<QAction, CELLS_COUNT>;
+
+    constexpr static const LineMasks WIN_MASKS = makeWinMasks<BOARD_SIZE, WIN_LENGTH, Mask>();
+    constexpr static const auto CELL_LINES = makeCellLines<BOARD_SIZE, WIN_LENGTH>();
+
+    constexpr static const std::array<std::array<std::uint64_t, CELLS_COUNT>, 2> ZOBRIST_KEYS =
+        makeZobristKeys<CELLS_COUNT>(0x5EED0F7A7C7043ULL);
+    constexpr static const auto TERNARY_DIGITS = makeTernaryDigits<(HAS_STATE ? CELLS_COUNT : 0), State>();
+
+    constexpr static int toCell(const QAction& action) {
+        return action.first * BOARD_SIZE + action.second;
     }
 
-    std::string toString() const {
-        std::string boardString;
-        for (int i = 0; i < m_size; ++i) {
-            for (int j = 0; j < m_size; ++j) {
-                boardString += m_board[i][j];
+    constexpr static QAction toAction(const int cell) {
+        return QAction{cell / BOARD_SIZE, cell % BOARD_SIZE};
+    }
+
+    static int lowestCell(const Mask mask) {
+        if constexpr (std::is_integral_v<Mask>) {
+            return lowestBit(mask);
+        } else {
+            int word = 0;
+            while (!mask.words[word]) {
+                ++word;
+            }
+            return word * 64 + lowestBit(mask.words[word]);
+        }
+    }
+
+    static int cellsCount(const Mask mask) {
+        if constexpr (std::is_integral_v<Mask>) {
+            return bitsCount(mask);
+        } else {
+            int count = 0;
+            for (const auto word : mask.words) {
+                count += bitsCount(word);
+            }
+            return count;
+        }
+    }
+
+    // The mask without its lowest cell.
+    static Mask withoutLowest(Mask mask) {
+        if constexpr (std::is_integral_v<Mask>) {
+            return Mask(mask & (mask - 1));
+        } else {
+            for (auto& word : mask.words) {
+                if (word) {
+                    word &= word - 1;
+                    break;
+                }
+            }
+            return mask;
+        }
+    }
+
+    static bool hasLine(const Mask mask) {
+        for (const auto& line : WIN_MASKS) {
+            if ((mask & line) == line) return true;
+        }
+        return false;
+    }
+
+    char at(const int row, const int col) const {
+        const auto bit = cellMask<Mask>(row * BOARD_SIZE + col);
+        if (Mask(m_first & bit) != Mask{}) return FIRST_PLAYER;
+        if (Mask(m_second & bit) != Mask{}) return SECOND_PLAYER;
+        return EMPTY_CELL;
+    }
+
+    Mask getMask(const char player) const {
+        return player == FIRST_PLAYER ? m_first : m_second;
+    }
+
+    Mask getEmptyMask() const {
+        return Mask(~m_occupied & FULL_MASK);
+    }
+
+    int getMovesCount() const {
+        return m_movesCount;
+    }
+
+    // The player to move, assuming the players alternated from the empty board.
+    char getCurrentPlayer() const {
+        return m_movesCount % 2 == 0 ? FIRST_PLAYER : SECOND_PLAYER;
+    }
+
+    // Pieces of player on line, an index into WIN_MASKS.
+    int getLineCount(const char player, const int line) const {
+        return m_lineCounts[playerIndex(player)][line];
+    }
+
+    bool operator==(const BasicBoard& other) const {
+        return m_first == other.m_first && m_second == other.m_second;
+    }
+
+    bool operator!=(const BasicBoard& other) const {
+        return !(*this == other);
+    }
+
+    State getState() const {
+        static_assert(HAS_STATE, "base-3 states need a board of at most 16 cells");
+        return State(TERNARY_DIGITS[m_first] + 2 * TERNARY_DIGITS[m_second]);
+    }
+
+    // Zobrist hash of the position, updated incrementally by move().
+    std::uint64_t getHash() const {
+        return m_hash;
+    }
+
+    static BasicBoard fromMasks(const Mask first, const Mask second) {
+        BasicBoard board;
+        for (Mask rest = first; rest != Mask{}; rest = withoutLowest(rest)) {
+            board.move(lowestCell(rest), FIRST_PLAYER);
+        }
+        for (Mask rest = second; rest != Mask{}; rest = withoutLowest(rest)) {
+            board.move(lowestCell(rest), SECOND_PLAYER);
+        }
+        return board;
+    }
+
+    static BasicBoard fromState(State state) {
+        static_assert(HAS_STATE, "base-3 states need a board of at most 16 cells");
+        BasicBoard board;
+        for (int cell = 0; cell < CELLS_COUNT; ++cell, state /= 3) {
+            if (state % 3 == 1) {
+                board.move(cell, FIRST_PLAYER);
+            } else if (state % 3 == 2) {
+                board.move(cell, SECOND_PLAYER);
             }
         }
+        return board;
+    }
+
+    std::string toString() const {
+        std::string boardString(CELLS_COUNT, EMPTY_CELL);
+        for (int cell = 0; cell < CELLS_COUNT; ++cell) {
+            boardString[cell] = at(cell / BOARD_SIZE, cell % BOARD_SIZE);
+        }
         return boardString;
     }
 
     std::string print() const {
         std::stringstream ss;
-        for (int i = 0; i < m_size; ++i) {
-            for (int j = 0; j < m_size; ++j) {
-                ss << m_board[i][j];
-                if (j < m_size - 1) {
+        for (int i = 0; i < BOARD_SIZE; ++i) {
+            for (int j = 0; j < BOARD_SIZE; ++j) {
+                ss << at(i, j);
+                if (j < BOARD_SIZE - 1) {
                     ss << " | ";
                 }
             }
             ss << std::endl;
-            if (i < m_size - 1) {
-                for (int j = 0; j < m_size * 4 - 1; ++j) {
+            if (i < BOARD_SIZE - 1) {
+                for (int j = 0; j < BOARD_SIZE * 4 - 1; ++j) {
                     ss << "-";
                 }
                 ss << std::endl;
@@ -52,48 +453,76 @@ public:
         return ss.str();
     }
 
+    // Updates masks, hash, move count and the counters of the lines through
+    // cell; completing a line marks the player as a winner.
+    void move(const int cell, const char player) {
+        const auto bit = cellMask<Mask>(cell);
+        const auto index = playerIndex(player);
+        if (index == 0) {
+            m_first |= bit;
+        } else {
+            m_second |= bit;
+        }
+        m_occupied |= bit;
+        m_hash ^= ZOBRIST_KEYS[index][cell];
+        ++m_movesCount;
+
+        auto& counts = m_lineCounts[index];
+        for (const auto line : CELL_LINES[cell]) {
+            if (++counts[line] == WIN_LENGTH) {
+                m_winners |= std::uint8_t(1 << index);
+            }
+        }
+    }
+
+    // Plays cell for the player to move.
+    void makeMove(const int cell) {
+        move(cell, getCurrentPlayer());
+    }
+
+    // Takes back the piece on cell, restoring the state before it was played.
+    void unmakeMove(const int cell) {
+        const auto bit = cellMask<Mask>(cell);
+        const auto index = Mask(m_first & bit) != Mask{} ? 0 : 1;
+        if (index == 0) {
+            m_first ^= bit;
+        } else {
+            m_second ^= bit;
+        }
+        m_occupied ^= bit;
+        m_hash ^= ZOBRIST_KEYS[index][cell];
+        --m_movesCount;
+
+        auto& counts = m_lineCounts[index];
+        for (const auto line : CELL_LINES[cell]) {
+            --counts[line];
+        }
+        if ((m_winners & (1 << index)) && !hasLine(index == 0 ? m_first : m_second)) {
+            m_winners &= std::uint8_t(~(1 << index));
+        }
+    }
+
     void move(const QAction& action, const char player) {
-        m_board[action.first][action.second] = player;
+        move(toCell(action), player);
     }
 
     bool checkAction(const QAction& action) const {
         const auto row = action.first;
         const auto col = action.second;
-        return row >= 0 && row < BOARD_SIZE && col >= 0 && col < BOARD_SIZE && m_board[row][col] == EMPTY_CELL;
+        return row >= 0 && row < BOARD_SIZE && col >= 0 && col < BOARD_SIZE 
+            && Mask(m_occupied & cellMask<Mask>(toCell(action))) == Mask{};
     }
 
     bool checkWin(const char player) const {
-        // Check rows and columns
-        for (int i = 0; i < m_size; ++i) {
-            bool rowWin = true;
-            bool colWin = true;
-            for (int j = 0; j < m_size; ++j) {
-                if (m_board[i][j] != player) rowWin = false; // Check row
-                if (m_board[j][i] != player) colWin = false; // Check column
-            }
-            if (rowWin || colWin) return true;
-        }
-        // Check diagonals
-        bool diag1Win = true;
-        bool diag2Win = true;
-        for (int i = 0; i < m_size; ++i) {
-            if (m_board[i][i] != player) diag1Win = false; // Check diagonal 1
-            if (m_board[i][m_size - 1 - i] != player) diag2Win = false; // Check diagonal 2
-        }
-        return diag1Win || diag2Win;
+        return m_winners & (1 << playerIndex(player));
     }
 
     bool isOver() const {
-        return checkDraw() || checkWin(FIRST_PLAYER) || checkWin(SECOND_PLAYER);
+        return m_winners || m_movesCount == CELLS_COUNT;
     }
 
     bool checkDraw() const {
-        for (const auto& row : m_board) {
-            for (char cell : row) {
-                if (cell == EMPTY_CELL) return false;
-            }
-        }
-        return true;
+        return m_movesCount == CELLS_COUNT;
     }
 
     QValue getAggressiveReward(const char player) const {
@@ -120,28 +549,44 @@ public:
         return reward;
     }
 
-    QActionList getAvailableActions() const {
-        std::vector<std::pair<int, int>> actions;
-        for (int i = 0; i < m_size; ++i) {
-            for (int j = 0; j < m_size; ++j) {
-                if (m_board[i][j] == EMPTY_CELL) {
-                    actions.push_back(std::make_pair(i, j));
-                }
-            }
+    ActionList getAvailableActions() const {
+        ActionList actions;
+        for (Mask empty = getEmptyMask(); empty != Mask{}; empty = withoutLowest(empty)) {
+            actions.push_back(toAction(lowestCell(empty)));
         }
         return actions;
     }
 
-    QAction getRandomAction() const {
-        const auto actions = getAvailableActions();
-        return actions[rand() % actions.size()];
+    QAction getRandomAction(Random& random) const {
+        return toAction(getRandomCell(getEmptyMask(), random));
     }
 
-    std::vector<std::vector<char>> getBoard() const {
-        return m_board;
+    // Uniformly random cell of a non-empty mask.
+    static int getRandomCell(Mask mask, Random& random) {
+        for (auto skip = random.nextIndex(cellsCount(mask)); skip > 0; --skip) {
+            mask = withoutLowest(mask);
+        }
+        return lowestCell(mask);
     }
 
 private:
-    std::vector<std::vector<char>> m_board;
-    const int m_size = BOARD_SIZE;
+    static int playerIndex(const char player) {
+        return player == FIRST_PLAYER ? 0 : 1;
+    }
+
+    Mask m_first{};
+    Mask m_second{};
+    Mask m_occupied{};
+    std::uint8_t m_movesCount = 0;
+    // Bit 0 is set when the first player has a line, bit 1 for the second.
+    std::uint8_t m_winners = 0;
+    std::array<std::array<std::uint8_t, LINES_COUNT>, 2> m_lineCounts{};
+    std::uint64_t m_hash = 0;
 };
+
+using Board = BasicBoard<3, 3>;
+using QActionList = Board::ActionList;
+
+inline char getOponent(const char player) {
+    return (player == Board::FIRST_PLAYER) ? Board::SECOND_PLAYER : Board::FIRST_PLAYER;
+}
@@ -1,101 +1,31 @@
 #include "game.h"
 #include "qvalues_agent.h"
 #include "minmax_agent.h"
+#include "training.h"
+#include "evaluation.h"
+#include "checkpoint.h"
+#include "solver.h"
+#include "policy_agent.h"
+#include "mcts_agent.h"
+#include "tournament.h"
 
 #include <fstream>
 #include <chrono>
+#include <thread>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <memory>
+#include <optional>
+#include <variant>
 
 const int NUM_EPISODES = 30000;
-const double LEARNING_RATE = 0.01;
-const double DISCOUNT_FACTOR = 0.8;
+const int NUM_TEST_GAMES = 10000;
+const int TOURNAMENT_MCTS_PLAYOUTS = 1000;
 
-void ticTacToeLearningOfFirstPlayer(QValuesAgent& firstPlayer, Agent& secondPlayer, const int episodes)
-{
-    for (int i = 0; i < episodes; ++i) {
-
-        if(i % 10 == 0) {
-            std::cout << i << std::endl;
-        }
-
-        const auto expRate = double(episodes - i) / episodes;
-
-        Board game;
-        auto nextState = game.toString();
-
-        while (true) {
-            const auto stateBeforeAction = nextState;
-            const auto action = firstPlayer.chooseAction(game, expRate);
-
-            game.move(action, Board::FIRST_PLAYER);
-            nextState = game.toString();
-
-            if(game.isOver()) {
-                firstPlayer.updateQValues(stateBeforeAction, "", action,
-                              game.getAggressiveReward(Board::FIRST_PLAYER), LEARNING_RATE, DISCOUNT_FACTOR);
-                break;
-            }
-
-            game.move(secondPlayer.chooseAction(game), Board::SECOND_PLAYER);
-            nextState = game.toString();
-
-            if(!game.isOver()) {
-                firstPlayer.updateQValues(stateBeforeAction, nextState, action, 0.0f, LEARNING_RATE, DISCOUNT_FACTOR);
-            } else {
-                firstPlayer.updateQValues(stateBeforeAction, "", action, -1.0f, LEARNING_RATE, DISCOUNT_FACTOR);
-                break;
-            }
-        }
-    }
-}
-
-void ticTacToeLearningOfSecondPlayer(QValuesAgent& secondPlayer, Agent& firstPlayer, const int episodes)
-{
-    auto now = std::chrono::steady_clock::now();
-    for (int i = 0; i < episodes; ++i) {
-
-        if(i % 10 == 0) {
-            const auto point = std::chrono::steady_clock::now();
-            const auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(point - now);
-            std::cout << i << ": " << diff.count() << " mills" << std::endl;
-            now = point;
-        }
-
-        const auto expRate = double(episodes - i) / episodes;
-
-        Board game;
-        auto nextState = game.toString();
-        auto stateBeforeAction = nextState;
-
-        QAction action;
-
-        while (true) {
-            game.move(firstPlayer.chooseAction(game), Board::FIRST_PLAYER);
-            nextState = game.toString();
-
-            if(game.checkWin(Board::FIRST_PLAYER)) {
-                secondPlayer.updateQValues(stateBeforeAction, "", action, -1.0f, LEARNING_RATE, DISCOUNT_FACTOR); //
-                break;
-            } else if(game.checkDraw()) {
-                secondPlayer.updateQValues(stateBeforeAction, "", action,
-                                           game.getDefensiveReward(Board::SECOND_PLAYER), LEARNING_RATE, DISCOUNT_FACTOR); //
-                break;
-            } else {
-                secondPlayer.updateQValues(stateBeforeAction, nextState, action, 0.0f, LEARNING_RATE, DISCOUNT_FACTOR);
-            }
-
-            stateBeforeAction = nextState;
-            action = secondPlayer.chooseAction(game, expRate);
-            game.move(action, Board::SECOND_PLAYER);
-            nextState = game.toString();
-
-            if(game.isOver()) {
-                secondPlayer.updateQValues(stateBeforeAction, "", action,
-                                          game.getDefensiveReward(Board::SECOND_PLAYER), LEARNING_RATE, DISCOUNT_FACTOR);
-                break;
-            }
-        }
-    }
-}
+// Opponents the AI trains and is tested against; visiting the variant gives
+// the game loops the concrete agent type.
+using OpponentAgent = std::variant<RandomAgent, MinMaxAgent>;
 
 void humanMove(Board& game, const char player) {
     int row, col;
@@ -109,11 +39,7 @@ void humanMove(Board& game, const char player) {
     }
 }
 
-const char getOponent(const char player) {
-    return (player == Board::FIRST_PLAYER) ? Board::SECOND_PLAYER : Board::FIRST_PLAYER;
-}
-
-void playTicTacToe(const char humanPlayer, const Agent& aiAgent) {
+void playTicTacToe(const char humanPlayer, const Agent& aiAgent, Random& random) {
     Board game;
 
     std::cout << "You are " << humanPlayer << ". ";
@@ -125,7 +51,7 @@ void playTicTacToe(const char humanPlayer, const Agent& aiAgent) {
         if (currentPlayer == humanPlayer) {
             humanMove(game, currentPlayer);
         } else {
-            const auto& action = aiAgent.chooseAction(game);
+            const auto& action = aiAgent.chooseAction(game, random);
             game.move(action, currentPlayer);
         }
 
@@ -144,42 +70,326 @@ void playTicTacToe(const char humanPlayer, const Agent& aiAgent) {
     }
 }
 
-void testTicTacToeAgent(const char targetPlayer, const Agent& aiAgent, const Agent& opponent) {
-    int wins = 0;
-    int draws = 0;
-    static const int GamesCount = 10000U;
-
-    for(int i = 0; i < GamesCount; ++i) {
-        Board game;
-        char currentPlayer = Board::FIRST_PLAYER;
-        while (!game.isOver()) {
-            if (currentPlayer == targetPlayer) {
-                const auto& action = aiAgent.chooseAction(game);
-                game.move(action, currentPlayer);
-            } else {
-                const auto& action = opponent.chooseAction(game);
-                game.move(action, currentPlayer);
+// Batched games ask the agents for the moves of a whole ply at once; both ways
+// depend on the seed only, but draw different games from it.
+template <typename AiAgent, typename Opponent>
+void testTicTacToeAgent(const char targetPlayer, const AiAgent& aiAgent, const Opponent& opponent,
+                        const int gamesCount, const std::uint64_t seed, const bool batched, ThreadPool& pool) {
+    if (batched) {
+        std::cout << evaluateAgentBatched(targetPlayer, aiAgent, opponent, gamesCount, seed, pool);
+    } else {
+        std::cout << evaluateAgent(targetPlayer, aiAgent, opponent, gamesCount, seed, pool);
+    }
+}
+
+struct Options {
+    std::uint64_t seed = static_cast<std::uint64_t>(std::time(nullptr));
+    unsigned threadsCount = std::max(1U, std::thread::hardware_concurrency());
+    std::string saveCheckpoint;
+    std::string loadCheckpoint;
+    // Checkpoints are checked against their checksum unless --checkpoint-checksum skip.
+    bool verifyCheckpoints = true;
+    // Test games are played in BoardBatch lockstep with --evaluation batched.
+    bool batchedEvaluation = false;
+    std::string telemetry;
+    TelemetryFormat telemetryFormat = TelemetryFormat::JsonLines;
+    std::chrono::milliseconds telemetryInterval{1000};
+    // Set when the table is solved exactly instead of learned.
+    std::optional<OpponentModel> solverOpponent;
+    // Set when training learns from a replay buffer instead of at every step.
+    std::optional<ReplayOptions> replay;
+    UpdateRuleOptions updateRule;
+    int episodes = NUM_EPISODES;
+    // Set when a network approximates the Q-values instead of a table.
+    std::optional<int> hiddenSize;
+    NetworkTrainingOptions network;
+    // Comma-separated entries of a round robin run instead of training, see makeTournamentEntry().
+    std::string tournament;
+    int tournamentGames = 200;
+    bool minMaxOpponent = false;
+    // Games are recorded to recordLog instead of training, or training replays trainLog.
+    std::string recordLog;
+    std::string trainLog;
+    int logPasses = 1;
+};
+
+bool parseOptions(const int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (i + 1 == argc) {
+            std::cout << "Missing value of " << option << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        if (option == "--seed") {
+            options.seed = std::stoull(value);
+        } else if (option == "--threads") {
+            options.threadsCount = std::max(1, std::stoi(value));
+        } else if (option == "--save-checkpoint") {
+            options.saveCheckpoint = value;
+        } else if (option == "--load-checkpoint") {
+            options.loadCheckpoint = value;
+        } else if (option == "--checkpoint-checksum" && (value == "verify" || value == "skip")) {
+            options.verifyCheckpoints = value == "verify";
+        } else if (option == "--evaluation" && (value == "sequential" || value == "batched")) {
+            options.batchedEvaluation = value == "batched";
+        } else if (option == "--solve" && (value == "optimal" || value == "uniform")) {
+            options.solverOpponent = value == "optimal" ? OpponentModel::Optimal : OpponentModel::Uniform;
+        } else if (option == "--replay" && (value == "uniform" || value == "prioritized")) {
+            options.replay = options.replay.value_or(ReplayOptions{});
+            options.replay->prioritized = value == "prioritized";
+        } else if (option == "--replay-ratio") {
+            options.replay = options.replay.value_or(ReplayOptions{});
+            options.replay->replayRatio = std::max(0.0, std::stod(value));
+        } else if (option == "--replay-importance") {
+            options.replay = options.replay.value_or(ReplayOptions{});
+            options.replay->importanceExponent = std::clamp(std::stod(value), 0.0, 1.0);
+        } else if (option == "--update-rule" && (value == "one-step" || value == "n-step" ||
+                                                 value == "accumulating" || value == "replacing")) {
+            options.updateRule.rule = value == "one-step"       ? UpdateRule::OneStep
+                                    : value == "n-step"       ? UpdateRule::NStep
+                                    : value == "accumulating" ? UpdateRule::AccumulatingTraces
+                                                              : UpdateRule::ReplacingTraces;
+        } else if (option == "--n-steps") {
+            options.updateRule.steps = std::max(1, std::stoi(value));
+        } else if (option == "--lambda") {
+            options.updateRule.lambda = std::clamp(std::stod(value), 0.0, 1.0);
+        } else if (option == "--episodes") {
+            options.episodes = std::max(1, std::stoi(value));
+        } else if (option == "--model" && (value == "table" || value == "linear" || value == "mlp")) {
+            options.hiddenSize.reset();
+            if (value != "table") {
+                options.hiddenSize = value == "mlp" ? MlpAgent::HIDDEN_SIZE : LinearAgent::HIDDEN_SIZE;
             }
+        } else if (option == "--batch-size") {
+            options.network.batchSize = std::size_t(std::max(1, std::stoi(value)));
+        } else if (option == "--tournament") {
+            options.tournament = value;
+        } else if (option == "--tournament-games") {
+            options.tournamentGames = std::max(1, std::stoi(value));
+        } else if (option == "--opponent" && (value == "random" || value == "minmax")) {
+            options.minMaxOpponent = value == "minmax";
+        } else if (option == "--record-log") {
+            options.recordLog = value;
+        } else if (option == "--train-log") {
+            options.trainLog = value;
+        } else if (option == "--log-passes") {
+            options.logPasses = std::max(1, std::stoi(value));
+        } else if (option == "--telemetry") {
+            options.telemetry = value;
+        } else if (option == "--telemetry-format" && (value == "jsonl" || value == "csv")) {
+            options.telemetryFormat = value == "csv" ? TelemetryFormat::Csv : TelemetryFormat::JsonLines;
+        } else if (option == "--telemetry-interval") {
+            options.telemetryInterval = std::chrono::milliseconds(std::max(1, std::stoi(value)));
+        } else {
+            std::cout << "Unknown option " << option << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Games of log, if given, are learned from instead of played against the opponent.
+template <typename Opponent>
+void trainAndTest(QValuesAgent& aiAgent, const char humanPlayer, const Opponent& opponent, const Options& options,
+                  const std::uint64_t trainingSeed, const std::uint64_t evaluationSeed, ThreadPool& pool,
+                  const TrajectoryLog* log) {
+    std::ofstream telemetryFile;
+    std::unique_ptr<TrainingTelemetry> telemetry;
+    if (!options.telemetry.empty()) {
+        telemetryFile.open(options.telemetry);
+        telemetry = std::make_unique<TrainingTelemetry>(telemetryFile, options.telemetryFormat, options.telemetryInterval);
+    }
 
-            if (game.checkWin(targetPlayer)) {
-                ++wins;
-                break;
-            } else if (game.checkDraw()) {
-                ++draws;
-                break;
+    // The learning episodes shape the first player's rewards aggressively and the second one's defensively
+    const auto aiPlayer = getOponent(humanPlayer);
+    const auto rewards = aiPlayer == Board::FIRST_PLAYER ? RewardShaping::Aggressive : RewardShaping::Defensive;
+
+    const auto learn = [&](const char learnerPlayer) {
+        if (log) {
+            const auto skipped = trajectoryLearning(aiAgent, *log, learnerPlayer, options.logPasses, telemetry.get(),
+                                                    options.updateRule);
+            if (skipped) {
+                std::cout << "Skipped " << skipped << " invalid trajectory records" << std::endl;
             }
+        } else if (options.replay) {
+            ticTacToeReplayLearning(aiAgent, opponent, learnerPlayer, options.episodes, options.threadsCount,
+                                    trainingSeed, *options.replay, telemetry.get());
+        } else {
+            ticTacToeParallelLearning(aiAgent, opponent, learnerPlayer, options.episodes, options.threadsCount,
+                                      trainingSeed, telemetry.get(), options.updateRule);
+        }
+    };
 
-            currentPlayer = getOponent(currentPlayer); // Switch players
+    if (options.solverOpponent) {
+        aiAgent.seed(Solver(aiPlayer, rewards, *options.solverOpponent));
+    } else if(humanPlayer == Board::FIRST_PLAYER) {
+        learn(Board::SECOND_PLAYER);
+
+        std::ofstream debug("second_player_qtree.txt");
+        aiAgent.print(debug);
+    } else {
+        learn(Board::FIRST_PLAYER);
+
+        std::ofstream debug("first_player_qtree.txt");
+        aiAgent.print(debug);
+    }
+
+    if (telemetry) {
+        telemetry->finish(aiAgent.getTable().size());
+    }
+
+    Random random(evaluationSeed);
+    std::cout << Solver(aiPlayer, rewards, OpponentModel::Optimal).measureGap(aiAgent, random);
+    testTicTacToeAgent(getOponent(humanPlayer), aiAgent, opponent, NUM_TEST_GAMES, evaluationSeed, options.batchedEvaluation, pool);
+}
+
+// Same as trainAndTest() for a network agent, which learns on one thread and has no checkpoints.
+template <typename NetworkAgent, typename Opponent>
+void trainAndTestNetwork(const char humanPlayer, const Opponent& opponent, const Options& options,
+                         const std::uint64_t trainingSeed, const std::uint64_t evaluationSeed, ThreadPool& pool) {
+    std::ofstream telemetryFile;
+    std::unique_ptr<TrainingTelemetry> telemetry;
+    if (!options.telemetry.empty()) {
+        telemetryFile.open(options.telemetry);
+        telemetry = std::make_unique<TrainingTelemetry>(telemetryFile, options.telemetryFormat, options.telemetryInterval);
+    }
+
+    const auto aiPlayer = getOponent(humanPlayer);
+    const auto rewards = aiPlayer == Board::FIRST_PLAYER ? RewardShaping::Aggressive : RewardShaping::Defensive;
+
+    NetworkAgent aiAgent(trainingSeed);
+    Random trainingRandom(trainingSeed, 1);
+    networkLearning(aiAgent, opponent, aiPlayer, options.episodes, options.network, trainingRandom, telemetry.get());
+    if (telemetry) {
+        telemetry->finish(aiAgent.getParametersCount());
+    }
+    std::cout << "Parameters: " << aiAgent.getParametersCount() << " (" << aiAgent.getMemorySize() << " bytes)"
+              << std::endl;
+
+    Random random(evaluationSeed);
+    std::cout << Solver(aiPlayer, rewards, OpponentModel::Optimal).measureGap(aiAgent, random);
+    testTicTacToeAgent(aiPlayer, aiAgent, opponent, NUM_TEST_GAMES, evaluationSeed, options.batchedEvaluation, pool);
+}
+
+// Agent playing the greedy policy of a checkpoint, learned for player: the
+// best actions the checkpoint stores, served from the mapping, or its table
+// for version 1 checkpoints. Nothing is computed before the first move.
+std::unique_ptr<Agent> loadCheckpointAgent(const std::string& path, const bool verifyChecksum, char& player) {
+    auto table = MappedQTable::load(path, verifyChecksum);
+    if (!table) {
+        return nullptr;
+    }
+    player = table->getPlayer();
+    if (table->getBestActionsBlock()) {
+        return std::make_unique<FrozenPolicyAgent>(std::move(*table));
+    }
+    const auto symmetric = table->isSymmetric();
+    return std::make_unique<BasicQValuesAgent<MappedQTable>>(std::move(*table), symmetric);
+}
+
+// Builds the agents of one tournament entry, kept alive by agents: random, minmax,
+// mcts[:PLAYOUTS], or checkpoint:FILE[+FILE] for the policies of checkpoints.
+// A seat without a checkpoint of its player is served by the first one, which
+// plays at random the positions it never learned. MCTS agents search one move at
+// a time, so every shard of games builds its own.
+bool makeTournamentEntry(const std::string& spec, const bool verifyCheckpoints,
+                         std::vector<std::unique_ptr<Agent>>& agents, std::vector<TournamentEntry>& entries) {
+    TournamentEntry entry{spec, nullptr, nullptr};
+    if (spec == "random") {
+        agents.push_back(std::make_unique<RandomAgent>());
+        entry.asFirst = entry.asSecond = agents.back().get();
+    } else if (spec == "minmax") {
+        agents.push_back(std::make_unique<MinMaxAgent>(Board::FIRST_PLAYER));
+        entry.asFirst = agents.back().get();
+        agents.push_back(std::make_unique<MinMaxAgent>(Board::SECOND_PLAYER));
+        entry.asSecond = agents.back().get();
+    } else if (spec == "mcts" || spec.rfind("mcts:", 0) == 0) {
+        // A playout expands at most one node into at most CELLS_COUNT children, so
+        // the arena holds one search and the tree is not kept between moves.
+        MctsOptions mctsOptions;
+        mctsOptions.playouts = spec == "mcts" ? TOURNAMENT_MCTS_PLAYOUTS : std::max(1, std::stoi(spec.substr(5)));
+        mctsOptions.nodesCapacity = std::size_t(mctsOptions.playouts) * Board::CELLS_COUNT + 1;
+        mctsOptions.reuseTree = false;
+        entry.makeAgent = [mctsOptions](const char player) -> std::unique_ptr<Agent> {
+            return std::make_unique<MctsAgent>(player, mctsOptions);
+        };
+    } else if (spec.rfind("checkpoint:", 0) == 0) {
+        std::stringstream files(spec.substr(std::string("checkpoint:").size()));
+        std::string file;
+        while (std::getline(files, file, '+')) {
+            char player = Board::EMPTY_CELL;
+            auto agent = loadCheckpointAgent(file, verifyCheckpoints, player);
+            if (!agent) {
+                std::cout << "Invalid checkpoint " << file << std::endl;
+                return false;
+            }
+            agents.push_back(std::move(agent));
+            auto& seat = player == Board::FIRST_PLAYER ? entry.asFirst : entry.asSecond;
+            seat = seat ? seat : agents.back().get();
+        }
+        if (!entry.asFirst && !entry.asSecond) {
+            std::cout << "No checkpoint in " << spec << std::endl;
+            return false;
         }
+        entry.asFirst = entry.asFirst ? entry.asFirst : entry.asSecond;
+        entry.asSecond = entry.asSecond ? entry.asSecond : entry.asFirst;
+    } else {
+        std::cout << "Unknown tournament entry " << spec << std::endl;
+        return false;
+    }
+    entries.push_back(entry);
+    return true;
+}
+
+int runTournament(const Options& options, const std::uint64_t seed, ThreadPool& pool) {
+    std::vector<std::unique_ptr<Agent>> agents;
+    std::vector<TournamentEntry> entries;
+    std::stringstream specs(options.tournament);
+    std::string spec;
+    while (std::getline(specs, spec, ',')) {
+        if (!makeTournamentEntry(spec, options.verifyCheckpoints, agents, entries)) {
+            return -1;
+        }
+    }
+    if (entries.size() < 2) {
+        std::cout << "A tournament needs at least two entries" << std::endl;
+        return -1;
     }
 
-    std::cout << "WinRate: " << double(wins) / GamesCount << std::endl;
-    std::cout << "WinRate(+Draws): " << double(wins + draws) / GamesCount << std::endl;
+    TournamentOptions tournamentOptions;
+    tournamentOptions.gamesPerSeat = options.tournamentGames;
+    tournamentOptions.seed = seed;
+    std::cout << playTournament(entries, tournamentOptions, pool);
+    return 0;
 }
 
-int main() {
-    // Seed the random number generator
-    std::srand(static_cast<unsigned int>(std::time(nullptr)));
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cout << "Usage: " << argv[0] << " [--seed N] [--threads N]"
+                  << " [--save-checkpoint FILE | --load-checkpoint FILE] [--checkpoint-checksum verify|skip]"
+                  << " [--evaluation sequential|batched]"
+                  << " [--solve optimal|uniform] [--opponent random|minmax]"
+                  << " [--record-log FILE | --train-log FILE [--log-passes N]]"
+                  << " [--tournament random,minmax,mcts[:N],checkpoint:FILE[+FILE],... [--tournament-games N]]"
+                  << " [--episodes N] [--update-rule one-step|n-step|accumulating|replacing]"
+                  << " [--n-steps N] [--lambda L] [--model table|linear|mlp] [--batch-size N]"
+                  << " [--replay uniform|prioritized] [--replay-ratio R] [--replay-importance B]"
+                  << " [--telemetry FILE [--telemetry-format jsonl|csv] [--telemetry-interval MS]]" << std::endl;
+        return -1;
+    }
+
+    // Training, evaluation and play draw from separate streams of the seed
+    Random random(options.seed);
+    const auto trainingSeed = random();
+    const auto evaluationSeed = random();
+    std::cout << "Seed: " << options.seed << std::endl;
+
+    ThreadPool pool(options.threadsCount);
+    if (!options.tournament.empty()) {
+        return runTournament(options, evaluationSeed, pool);
+    }
 
     std::cout << "Let's play Tic Tac Toe!" << std::endl;
     std::cout << "Choose your player: X or O: ";
@@ -191,30 +401,75 @@ int main() {
         return -1;
     }
 
-    QValuesAgent aiAgent;
-    Agent* opponent;
+    OpponentAgent opponent;
 
-    if(0) {
-        opponent = new MinMaxAgent{humanPlayer};
-    } else {
-        opponent = new RandomAgent{};
+    if(options.minMaxOpponent) {
+        opponent.emplace<MinMaxAgent>(humanPlayer);
     }
 
-    if(humanPlayer == Board::FIRST_PLAYER) {
-        ticTacToeLearningOfSecondPlayer(aiAgent, *opponent, NUM_EPISODES);
+    const auto aiPlayer = getOponent(humanPlayer);
+    int result = 0;
 
-        std::ofstream debug("second_player_qtree.txt");
-        aiAgent.print(debug);
-    } else {
-        ticTacToeLearningOfFirstPlayer(aiAgent, *opponent, NUM_EPISODES);
-
-        std::ofstream debug("first_player_qtree.txt");
-        aiAgent.print(debug);
+    if (!options.recordLog.empty()) {
+        // The AI's seat is played at random, so the games cover the positions a learner explores
+        TrajectoryRecorder recorder(options.recordLog);
+        const RandomAgent explorer;
+        std::visit([&](const auto& opponentAgent) {
+            if (aiPlayer == Board::FIRST_PLAYER) {
+                recordGames(explorer, opponentAgent, options.episodes, trainingSeed, pool, recorder);
+            } else {
+                recordGames(opponentAgent, explorer, options.episodes, trainingSeed, pool, recorder);
+            }
+        }, opponent);
+        const auto gamesCount = recorder.size();
+        if (!recorder.close()) {
+            std::cout << "Can't write trajectory log " << options.recordLog << std::endl;
+            return -1;
+        }
+        std::cout << "Recorded " << gamesCount << " games to " << options.recordLog << std::endl;
+        return 0;
     }
 
-    testTicTacToeAgent(getOponent(humanPlayer), aiAgent, *opponent);
+    std::optional<TrajectoryLog> trainingLog;
+    if (!options.trainLog.empty()) {
+        trainingLog = TrajectoryLog::open(options.trainLog);
+        if (!trainingLog) {
+            std::cout << "Invalid trajectory log " << options.trainLog << std::endl;
+            return -1;
+        }
+    }
 
-    delete opponent;
+    if (options.hiddenSize) {
+        std::visit([&](const auto& opponentAgent) {
+            if (*options.hiddenSize > 0) {
+                trainAndTestNetwork<MlpAgent>(humanPlayer, opponentAgent, options, trainingSeed, evaluationSeed, pool);
+            } else {
+                trainAndTestNetwork<LinearAgent>(humanPlayer, opponentAgent, options, trainingSeed, evaluationSeed, pool);
+            }
+        }, opponent);
+    } else if (!options.loadCheckpoint.empty()) {
+        // A checkpoint replaces training: its greedy policy serves the moves
+        char player = Board::EMPTY_CELL;
+        const auto aiAgent = loadCheckpointAgent(options.loadCheckpoint, options.verifyCheckpoints, player);
+        if (aiAgent && player == aiPlayer) {
+            std::visit([&](const auto& opponentAgent) {
+                testTicTacToeAgent(aiPlayer, *aiAgent, opponentAgent, NUM_TEST_GAMES, evaluationSeed, options.batchedEvaluation, pool);
+            }, opponent);
+        } else {
+            std::cout << "Invalid checkpoint " << options.loadCheckpoint << std::endl;
+            result = -1;
+        }
+    } else {
+        QValuesAgent aiAgent;
+        std::visit([&](const auto& opponentAgent) {
+            trainAndTest(aiAgent, humanPlayer, opponentAgent, options, trainingSeed, evaluationSeed, pool,
+                         trainingLog ? &*trainingLog : nullptr);
+        }, opponent);
+        if (!options.saveCheckpoint.empty() && !saveCheckpoint(options.saveCheckpoint, aiAgent, aiPlayer)) {
+            std::cout << "Can't write checkpoint " << options.saveCheckpoint << std::endl;
+            result = -1;
+        }
+    }
 
-    return 0;
+    return result;
 }
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+#include "game.h"
+#include "agent.h"
+#include "random.h"
+#include "thread_pool.h"
+
+struct MctsOptions {
+    // Search budget: playouts per move and/or wall time per move, 0 meaning no limit.
+    // Without any limit the agent makes one playout per move.
+    int playouts = 10000;
+    std::chrono::milliseconds time{0};
+    unsigned threadsCount = 1;
+    double exploration = 1.41;
+    std::size_t nodesCapacity = 1 << 20;
+    // Keep the subtree of the position reached since the previous move.
+    bool reuseTree = true;
+};
+
+// Monte Carlo tree search with UCT selection and random playouts.
+// Nodes live in an arena allocated once by the constructor. Threads search
+// one shared tree: a node is counted as visited when a thread descends into
+// it and scored when the playout result is backed up, so pending playouts
+// act as virtual losses that steer other threads to different branches.
+// chooseAction() calls of one agent are serialized.
+template <typename GameBoard>
+class BasicMctsAgent final : public BasicAgent<GameBoard> {
+    using Mask = typename GameBoard::Mask;
+
+    constexpr static const std::uint32_t NO_NODE = std::numeric_limits<std::uint32_t>::max();
+
+    enum Expansion : std::uint8_t {
+        UNEXPANDED,
+        EXPANDING,
+        EXPANDED,
+        // The arena had no room for the children: the node stays a leaf.
+        LEAF
+    };
+
+    struct Node {
+        // Score is in half points for the player who moved into the node: 2 win, 1 draw.
+        std::atomic<std::int32_t> visits{0};
+        std::atomic<std::int32_t> score{0};
+        std::atomic<std::uint8_t> expansion{UNEXPANDED};
+        // Written by the expanding thread before expansion becomes EXPANDED.
+        std::uint32_t firstChild = 0;
+        std::uint16_t childrenCount = 0;
+        std::int16_t cell = -1;
+
+        void reset(const int nodeCell) {
+            visits.store(0, std::memory_order_relaxed);
+            score.store(0, std::memory_order_relaxed);
+            expansion.store(UNEXPANDED, std::memory_order_relaxed);
+            firstChild = 0;
+            childrenCount = 0;
+            cell = std::int16_t(nodeCell);
+        }
+    };
+
+    using Path = FixedList<std::uint32_t, GameBoard::CELLS_COUNT + 1>;
+
+    struct Tree {
+        explicit Tree(const std::size_t capacity) : nodes(capacity) {}
+
+        std::mutex mutex;
+        std::vector<Node> nodes;
+        std::atomic<std::size_t> used{0};
+        std::uint32_t root = NO_NODE;
+        GameBoard rootBoard;
+    };
+
+public:
+    BasicMctsAgent(const char player, const MctsOptions& options = MctsOptions{})
+        : m_player(player)
+        , m_opponent(getOponent(player))
+        , m_options(withBudget(options))
+        , m_tree(std::make_unique<Tree>(m_options.nodesCapacity))
+        , m_pool(m_options.threadsCount > 1 ? std::make_unique<ThreadPool>(m_options.threadsCount) : nullptr) {}
+
+    QAction chooseAction(const GameBoard& game, Random& random) const override {
+        std::lock_guard<std::mutex> lock(m_tree->mutex);
+        prepareRoot(game);
+
+        const auto deadline = std::chrono::steady_clock::now() + m_options.time;
+        std::atomic<int> playouts{0};
+        const auto search = [&](Random& threadRandom) {
+            while ((m_options.playouts == 0 || playouts.fetch_add(1, std::memory_order_relaxed) < m_options.playouts)
+                   && (m_options.time.count() == 0 || std::chrono::steady_clock::now() < deadline)) {
+                playout(threadRandom);
+            }
+        };
+
+        if (m_pool) {
+            const auto seed = random();
+            m_pool->parallelFor(m_pool->size(), [&](const std::size_t index) {
+                Random threadRandom(seed, index);
+                search(threadRandom);
+            });
+        } else {
+            search(random);
+        }
+
+        return GameBoard::toAction(getMostVisitedCell());
+    }
+
+    // Nodes in use, including those kept from previous moves.
+    std::size_t getTreeSize() const {
+        return std::min(m_tree->used.load(std::memory_order_relaxed), m_tree->nodes.size());
+    }
+
+private:
+    // Negative limits count as none, and a search needs at least one limit to end.
+    // The arena needs room for the root at least.
+    static MctsOptions withBudget(MctsOptions options) {
+        options.nodesCapacity = std::max<std::size_t>(1, options.nodesCapacity);
+        options.playouts = std::max(0, options.playouts);
+        options.time = std::max(std::chrono::milliseconds(0), options.time);
+        if (options.playouts == 0 && options.time.count() == 0) {
+            options.playouts = 1;
+        }
+        return options;
+    }
+
+    std::uint32_t allocate(const std::size_t count) const {
+        const auto first = m_tree->used.fetch_add(count, std::memory_order_relaxed);
+        if (first + count > m_tree->nodes.size()) {
+            return NO_NODE;
+        }
+        return std::uint32_t(first);
+    }
+
+    void resetTree(const GameBoard& game) const {
+        m_tree->used.store(0, std::memory_order_relaxed);
+        m_tree->root = allocate(1);
+        m_tree->nodes[m_tree->root].reset(-1);
+        m_tree->rootBoard = game;
+    }
+
+    // Our move and the opponent's reply lead from the previous root to the game,
+    // unless the game was restarted or is a different one.
+    std::uint32_t findSubtree(const GameBoard& game) const {
+        const auto& nodes = m_tree->nodes;
+        const auto root = m_tree->root;
+        if (root == NO_NODE) {
+            return NO_NODE;
+        }
+        if (m_tree->rootBoard == game) {
+            return root;
+        }
+        if (nodes[root].expansion.load(std::memory_order_relaxed) != EXPANDED) {
+            return NO_NODE;
+        }
+        for (auto child = nodes[root].firstChild; child < nodes[root].firstChild + nodes[root].childrenCount; ++child) {
+            const auto& node = nodes[child];
+            if (node.expansion.load(std::memory_order_relaxed) != EXPANDED) {
+                continue;
+            }
+            for (auto grandchild = node.firstChild; grandchild < node.firstChild + node.childrenCount; ++grandchild) {
+                auto board = m_tree->rootBoard;
+                board.move(node.cell, m_player);
+                board.move(nodes[grandchild].cell, m_opponent);
+                if (board == game) {
+                    return grandchild;
+                }
+            }
+        }
+        return NO_NODE;
+    }
+
+    void prepareRoot(const GameBoard& game) const {
+        // Reused subtrees stay where they are in the arena, so a half full arena is cleared instead.
+        if (m_options.reuseTree && getTreeSize() < m_tree->nodes.size() / 2) {
+            const auto subtree = findSubtree(game);
+            if (subtree != NO_NODE) {
+                m_tree->root = subtree;
+                m_tree->rootBoard = game;
+                return;
+            }
+        }
+        resetTree(game);
+    }
+
+    // Creates the children of the node unless another thread does; true when the node has children.
+    bool expand(Node& node, const GameBoard& board) const {
+        auto expansion = node.expansion.load(std::memory_order_acquire);
+        if (expansion != UNEXPANDED) {
+            return expansion == EXPANDED;
+        }
+        if (!node.expansion.compare_exchange_strong(expansion, EXPANDING, std::memory_order_acquire)) {
+            return false;
+        }
+
+        const auto empty = board.getEmptyMask();
+        const auto first = allocate(std::size_t(GameBoard::cellsCount(empty)));
+        if (first == NO_NODE) {
+            node.expansion.store(LEAF, std::memory_order_release);
+            return false;
+        }
+        auto child = first;
+        for (Mask rest = empty; rest != Mask{}; rest = GameBoard::withoutLowest(rest)) {
+            m_tree->nodes[child++].reset(GameBoard::lowestCell(rest));
+        }
+        node.firstChild = first;
+        node.childrenCount = std::uint16_t(child - first);
+        node.expansion.store(EXPANDED, std::memory_order_release);
+        return true;
+    }
+
+    std::uint32_t selectChild(const Node& node) const {
+        const auto& nodes = m_tree->nodes;
+        const auto logVisits = std::log(double(std::max(1, node.visits.load(std::memory_order_relaxed))));
+        auto best = node.firstChild;
+        auto bestValue = std::numeric_limits<double>::lowest();
+        for (auto child = node.firstChild; child < node.firstChild + node.childrenCount; ++child) {
+            const auto visits = nodes[child].visits.load(std::memory_order_relaxed);
+            if (visits == 0) {
+                return child;
+            }
+            const auto value = nodes[child].score.load(std::memory_order_relaxed) / (2.0 * visits)
+                               + m_options.exploration * std::sqrt(logVisits / visits);
+            if (value > bestValue) {
+                bestValue = value;
+                best = child;
+            }
+        }
+        return best;
+    }
+
+    // One iteration: selection and expansion down the tree, a random playout, backup.
+    void playout(Random& random) const {
+        auto& nodes = m_tree->nodes;
+        auto board = m_tree->rootBoard;
+        auto player = m_player;
+
+        Path path;
+        auto index = m_tree->root;
+        nodes[index].visits.fetch_add(1, std::memory_order_relaxed);
+        path.push_back(index);
+        while (!board.isOver() && expand(nodes[index], board)) {
+            index = selectChild(nodes[index]);
+            nodes[index].visits.fetch_add(1, std::memory_order_relaxed);
+            path.push_back(index);
+            board.move(nodes[index].cell, player);
+            player = getOponent(player);
+        }
+
+        while (!board.isOver()) {
+            board.move(board.getRandomAction(random), player);
+            player = getOponent(player);
+        }
+
+        // The root is entered by the opponent's move, then movers alternate.
+        const auto winner = board.checkWin(m_player) ? m_player : board.checkWin(m_opponent) ? m_opponent : GameBoard::EMPTY_CELL;
+        auto mover = m_opponent;
+        for (const auto node : path) {
+            const auto score = winner == mover ? 2 : winner == GameBoard::EMPTY_CELL ? 1 : 0;
+            if (score) {
+                nodes[node].score.fetch_add(score, std::memory_order_relaxed);
+            }
+            mover = getOponent(mover);
+        }
+    }
+
+    int getMostVisitedCell() const {
+        const auto& nodes = m_tree->nodes;
+        const auto& root = nodes[m_tree->root];
+        if (root.expansion.load(std::memory_order_relaxed) != EXPANDED) {
+            return GameBoard::lowestCell(m_tree->rootBoard.getEmptyMask());
+        }
+        auto best = root.firstChild;
+        for (auto child = root.firstChild; child < root.firstChild + root.childrenCount; ++child) {
+            if (nodes[child].visits.load(std::memory_order_relaxed) > nodes[best].visits.load(std::memory_order_relaxed)) {
+                best = child;
+            }
+        }
+        return nodes[best].cell;
+    }
+
+    const char m_player;
+    const char m_opponent;
+    const MctsOptions m_options;
+    const std::unique_ptr<Tree> m_tree;
+    const std::unique_ptr<ThreadPool> m_pool;
+};
+
+using MctsAgent = BasicMctsAgent<Board>;
@@ -3,133 +3,459 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <algorithm>
 #include <ctime>
 #include <cstdlib>
 #include <limits>
 #include <sstream>
 #include <cmath>
+#include <memory>
+#include <chrono>
+#include <array>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
 
 #include "game.h"
 #include "agent.h"
+#include "symmetry.h"
+#include "transposition_table.h"
+#include "thread_pool.h"
 
-class MinMaxAgent final : public Agent {
-public:
-    MinMaxAgent(const char player) : m_player(player) {}
+struct MinMaxOptions {
+    // Budget of the iterative-deepening search per move; with neither a time
+    // nor a depth limit every move is searched to the end of the game.
+    std::chrono::milliseconds time{0};
+    int maxDepth = 0;
+    bool useTranspositionTable = true;
+    // More than one thread searches the moves of big subtrees in parallel.
+    unsigned threadsCount = 1;
+};
 
-    constexpr static int ALPHA = -999999;
-    constexpr static int BETA = 999999;
+// Symmetric moves are searched once on the 3x3 board, every move on the others.
+// The parallel search splits a node Young Brothers Wait style: its first move
+// is searched alone, then the other moves are shared between the threads,
+// each starting with the best bounds found so far.
+template <typename GameBoard>
+class BasicMinMaxAgent final : public BasicAgent<GameBoard> {
+    using Mask = typename GameBoard::Mask;
+    using Moves = FixedList<int, GameBoard::CELLS_COUNT>;
 
-    QAction chooseAction(const Board& game) const override {
-        int bestScore = -999;
-        QAction bestMove;
-
-        auto board = game.getBoard();
-        for (int i = 0; i < Board::BOARD_SIZE; ++i) {
-            for (int j = 0; j < Board::BOARD_SIZE; ++j) {
-                if (board[i][j] == Board::EMPTY_CELL) {
-                    board[i][j] = m_player;
-                    int currentScore = minimax(board, 0, false);
-                    board[i][j] = Board::EMPTY_CELL;
-                    if (currentScore > bestScore) {
-                        bestScore = currentScore;
-                        bestMove = std::make_pair(i, j);
-                    }
-                }
-            }
-        }
+    constexpr static const int UNLIMITED_DEPTH = std::numeric_limits<int>::max();
 
-        return bestMove;
-    }
+    // Nodes are split when their subtree, counted without pruning, has at least this many leaves.
+    constexpr static const std::int64_t MIN_SPLIT_LEAVES = 1 << 16;
 
-    // Function to check if a player has won the game
-    static bool checkWin(const std::vector<std::vector<char>>& board, char player) {
-        // Check rows and columns
-        for (int i = 0; i < Board::BOARD_SIZE; ++i) {
-            if ((board[i][0] == player && board[i][1] == player && board[i][2] == player) ||
-                (board[0][i] == player && board[1][i] == player && board[2][i] == player)) {
-                return true;
+    // Limits of one iteration of the deepening, shared by all threads.
+    struct SearchLimits {
+        int depthLimit = UNLIMITED_DEPTH;
+        bool timed = false;
+        std::chrono::steady_clock::time_point deadline;
+        std::atomic<bool> timeUp{false};
+    };
+
+    // A node whose remaining moves are searched in parallel.
+    struct SplitPoint {
+        const SplitPoint* parent = nullptr;
+        std::atomic<bool> cutoff{false};
+        // Guarded by mutex.
+        std::mutex mutex;
+        int alpha = ALPHA;
+        int beta = BETA;
+        int bestScore = 0;
+        int bestCell = TranspositionTable::NO_MOVE;
+    };
+
+    // State of one thread of the search. A search is aborted when the time is up or a
+    // split point it belongs to was cut off; its result is then discarded.
+    struct SearchContext {
+        explicit SearchContext(SearchLimits& searchLimits) : limits(searchLimits) {
+            for (auto& plyKillers : killers) {
+                plyKillers = {TranspositionTable::NO_MOVE, TranspositionTable::NO_MOVE};
             }
         }
-        // Check diagonals
-        if ((board[0][0] == player && board[1][1] == player && board[2][2] == player) ||
-            (board[0][2] == player && board[1][1] == player && board[2][0] == player)) {
-            return true;
+
+        SearchLimits& limits;
+        const SplitPoint* split = nullptr;
+        bool aborted = false;
+        std::uint64_t nodes = 0;
+        // Two latest moves causing a cutoff at each ply, and cutoffs per player and cell.
+        std::array<std::array<int, 2>, GameBoard::CELLS_COUNT + 1> killers;
+        std::array<std::array<int, GameBoard::CELLS_COUNT>, 2> history{};
+    };
+
+    static Mask getMoves(const GameBoard& board) {
+        if constexpr (std::is_same_v<GameBoard, Board>) {
+            return Symmetry::getDistinctMoves(board);
+        } else {
+            return board.getEmptyMask();
         }
-        return false;
     }
 
-    // Function to check if the board is full
-    static bool boardFull(const std::vector<std::vector<char>>& board) {
-        for (int i = 0; i < Board::BOARD_SIZE; ++i) {
-            for (int j = 0; j < Board::BOARD_SIZE; ++j) {
-                if (board[i][j] == Board::EMPTY_CELL) {
-                    return false;
-                }
+public:
+    // The transposition table, when enabled, lives as long as the agent
+    // and is shared by all chooseAction() calls.
+    BasicMinMaxAgent(const char player, const bool useTranspositionTable = true)
+        : BasicMinMaxAgent(player, MinMaxOptions{std::chrono::milliseconds(0), 0, useTranspositionTable}) {}
+
+    BasicMinMaxAgent(const char player, const MinMaxOptions& options)
+        : m_player(player)
+        , m_opponent(player == GameBoard::FIRST_PLAYER ? GameBoard::SECOND_PLAYER : GameBoard::FIRST_PLAYER)
+        , m_options(options)
+        , m_table(options.useTranspositionTable ? std::make_unique<TranspositionTable>() : nullptr)
+        , m_pool(options.threadsCount > 1 ? std::make_unique<ThreadPool>(options.threadsCount) : nullptr) {}
+
+    constexpr static int ALPHA = -999999;
+    constexpr static int BETA = 999999;
+    // Score of a won game; heuristic scores stay well inside (-WIN_SCORE, WIN_SCORE).
+    constexpr static int WIN_SCORE = 10000;
+
+    QAction chooseAction(const GameBoard& game, Random&) const override {
+        // One copy for the whole search, which makes and unmakes moves in place.
+        GameBoard board = game;
+        SearchLimits limits;
+        SearchContext context(limits);
+        if (m_options.time.count() == 0 && m_options.maxDepth == 0) {
+            return GameBoard::toAction(searchRoot(board, context, TranspositionTable::NO_MOVE).second);
+        }
+
+        // Iterative deepening: every iteration starts with the best move of the previous
+        // one, and the last complete iteration decides when time runs out.
+        limits.timed = m_options.time.count() > 0;
+        limits.deadline = std::chrono::steady_clock::now() + m_options.time;
+        const auto maxDepth = m_options.maxDepth > 0 ? m_options.maxDepth : GameBoard::CELLS_COUNT;
+        auto bestCell = GameBoard::lowestCell(board.getEmptyMask());
+        for (int depth = 1; depth <= maxDepth; ++depth) {
+            limits.depthLimit = depth;
+            const auto result = searchRoot(board, context, bestCell);
+            if (context.aborted) {
+                break;
+            }
+            bestCell = result.second;
+            if (std::abs(result.first) >= WIN_SCORE || depth >= GameBoard::CELLS_COUNT - board.getMovesCount()) {
+                break;
             }
         }
-        return true;
+        return GameBoard::toAction(bestCell);
     }
 
     // Function to evaluate the board state
-    int evaluate(const std::vector<std::vector<char>>& board) const {
-        if (checkWin(board, m_player)) {
-            return 1;
-        } else if (checkWin(board, m_player == Board::FIRST_PLAYER ? Board::SECOND_PLAYER : m_player)) {
-            return -1;
+    int evaluate(const GameBoard& board) const {
+        if (board.checkWin(m_player)) {
+            return WIN_SCORE;
+        } else if (board.checkWin(m_opponent)) {
+            return -WIN_SCORE;
         } else {
             return 0;
         }
     }
 
-    // Minimax algorithm with alpha-beta pruning
-    int minimax(std::vector<std::vector<char>>& board, int depth, bool isMaximizing, int alpha = ALPHA, int beta = BETA) const {
+    // Heuristic value of a position at the depth limit: every line still open
+    // to one player only counts for that player, more with more pieces on it.
+    int evaluateOpenLines(const GameBoard& board) const {
+        int score = 0;
+        for (int line = 0; line < GameBoard::LINES_COUNT; ++line) {
+            const auto own = board.getLineCount(m_player, line);
+            const auto opponent = board.getLineCount(m_opponent, line);
+            if (!opponent) {
+                score += getLineWeight(own);
+            } else if (!own) {
+                score -= getLineWeight(opponent);
+            }
+        }
+        return std::max(-WIN_SCORE / 2, std::min(score, WIN_SCORE / 2));
+    }
+
+private:
+    // Minimax algorithm with alpha-beta pruning, moves leading to symmetric positions are searched once
+    int minimax(GameBoard& board, SearchContext& context, int depth, bool isMaximizing, int alpha = ALPHA,
+                int beta = BETA) const {
         int score = evaluate(board);
 
         if (score != 0) {
             return score;
         }
 
-        if (boardFull(board)) {
+        if (board.checkDraw()) {
+            return 0;
+        }
+
+        if (depth >= context.limits.depthLimit) {
+            return evaluateOpenLines(board);
+        }
+
+        if (isAborted(context)) {
             return 0;
         }
 
-        if (isMaximizing) {
-            int maxScore = -999;
-            for (int i = 0; i < Board::BOARD_SIZE; ++i) {
-                for (int j = 0; j < Board::BOARD_SIZE; ++j) {
-                    if (board[i][j] == Board::EMPTY_CELL) {
-                        board[i][j] = m_player;
-                        int currentScore = minimax(board, depth + 1, false, alpha, beta);
-                        board[i][j] = Board::EMPTY_CELL;
-                        maxScore = std::max(maxScore, currentScore);
-                        alpha = std::max(alpha, currentScore);
-                        if (beta <= alpha) {
-                            break;
-                        }
-                    }
+        const int remainingDepth = getRemainingDepth(context, depth);
+        const int alphaOrig = alpha;
+        const int betaOrig = beta;
+        int hashMove = TranspositionTable::NO_MOVE;
+        if (m_table) {
+            TranspositionTable::Entry entry;
+            if (m_table->probe(board.getHash(), entry)) {
+                hashMove = entry.move;
+                if (entry.depth >= remainingDepth && TranspositionTable::narrow(entry, alpha, beta, score)) {
+                    return score;
                 }
             }
-            return maxScore;
-        } else {
-            int minScore = 999;
-            for (int i = 0; i < Board::BOARD_SIZE; ++i) {
-                for (int j = 0; j < Board::BOARD_SIZE; ++j) {
-                    if (board[i][j] == Board::EMPTY_CELL) {
-                        board[i][j] = m_player == Board::FIRST_PLAYER ? Board::SECOND_PLAYER : m_player;
-                        int currentScore = minimax(board, depth + 1, true, alpha, beta);
-                        board[i][j] = Board::EMPTY_CELL;
-                        minScore = std::min(minScore, currentScore);
-                        beta = std::min(beta, currentScore);
-                        if (beta <= alpha) {
-                            break;
-                        }
-                    }
+        }
+
+        const auto player = isMaximizing ? m_player : m_opponent;
+        auto moves = getMoveList(board);
+        int bestScore = isMaximizing ? ALPHA : BETA;
+        int bestCell = TranspositionTable::NO_MOVE;
+        for (std::size_t i = 0; i < moves.size(); ++i) {
+            if (i == 1 && isSplitNode(board, context, depth)) {
+                for (auto j = i; j < moves.size(); ++j) {
+                    selectNextMove(moves, j, context, depth, player, hashMove);
                 }
+                searchInParallel(board, context, depth, isMaximizing, moves, i, alpha, beta, bestScore, bestCell,
+                                 remainingDepth);
+                break;
+            }
+            const auto cell = selectNextMove(moves, i, context, depth, player, hashMove);
+            board.move(cell, player);
+            const int currentScore = minimax(board, context, depth + 1, !isMaximizing, alpha, beta);
+            board.unmakeMove(cell);
+            if (isMaximizing ? currentScore > bestScore : currentScore < bestScore) {
+                bestScore = currentScore;
+                bestCell = cell;
+            }
+            if (isMaximizing) {
+                alpha = std::max(alpha, currentScore);
+            } else {
+                beta = std::min(beta, currentScore);
+            }
+            if (beta <= alpha) {
+                recordCutoff(context, depth, player, cell, remainingDepth);
+                break;
             }
-            return minScore;
+        }
+
+        if (!context.aborted) {
+            store(board, bestScore, alphaOrig, betaOrig, remainingDepth, bestCell);
+        }
+        return bestScore;
+    }
+
+    static int getLineWeight(const int pieces) {
+        return pieces ? 1 << (3 * (pieces - 1)) : 0;
+    }
+
+    static int getRemainingDepth(const SearchContext& context, const int depth) {
+        return context.limits.depthLimit == UNLIMITED_DEPTH
+                   ? TranspositionTable::FULL_DEPTH
+                   : std::min(context.limits.depthLimit - depth, TranspositionTable::FULL_DEPTH - 1);
+    }
+
+    // The clock and the split points are checked every 256 nodes; the first iteration always completes.
+    static bool isAborted(SearchContext& context) {
+        if (!context.aborted && (++context.nodes & 0xFF) == 0) {
+            context.aborted = checkAborted(context);
+        }
+        return context.aborted;
+    }
+
+    static bool checkAborted(const SearchContext& context) {
+        auto& limits = context.limits;
+        if (limits.timeUp.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        if (limits.timed && limits.depthLimit > 1 && std::chrono::steady_clock::now() >= limits.deadline) {
+            limits.timeUp.store(true, std::memory_order_relaxed);
+            return true;
+        }
+        for (auto split = context.split; split; split = split->parent) {
+            if (split->cutoff.load(std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool isSplitNode(const GameBoard& board, const SearchContext& context, const int depth) const {
+        if (!m_pool) {
+            return false;
+        }
+        auto empty = GameBoard::CELLS_COUNT - board.getMovesCount();
+        const auto plies = std::min(context.limits.depthLimit - depth, empty);
+        std::int64_t leaves = 1;
+        for (int ply = 0; ply < plies && leaves < MIN_SPLIT_LEAVES; ++ply) {
+            leaves *= empty--;
+        }
+        return leaves >= MIN_SPLIT_LEAVES;
+    }
+
+    // Searches moves from index first on in parallel, each on its own copy of the board and
+    // the context, and folds the results into the bounds and the best move of the node.
+    void searchInParallel(const GameBoard& board, SearchContext& context, const int depth, const bool isMaximizing,
+                          const Moves& moves, const std::size_t first, int& alpha, int& beta, int& bestScore,
+                          int& bestCell, const int remainingDepth) const {
+        const auto player = isMaximizing ? m_player : m_opponent;
+        SplitPoint split;
+        split.parent = context.split;
+        split.alpha = alpha;
+        split.beta = beta;
+        split.bestScore = bestScore;
+        split.bestCell = bestCell;
+
+        m_pool->parallelFor(moves.size() - first, [&](const std::size_t index) {
+            if (split.cutoff.load(std::memory_order_relaxed) || checkAborted(context)) {
+                return;
+            }
+            const auto cell = moves[first + index];
+            auto child = board;
+            auto childContext = context;
+            childContext.split = &split;
+            int childAlpha;
+            int childBeta;
+            {
+                std::lock_guard<std::mutex> lock(split.mutex);
+                childAlpha = split.alpha;
+                childBeta = split.beta;
+            }
+            child.move(cell, player);
+            const int score = minimax(child, childContext, depth + 1, !isMaximizing, childAlpha, childBeta);
+            if (childContext.aborted) {
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(split.mutex);
+            if (split.cutoff.load(std::memory_order_relaxed)) {
+                return;
+            }
+            if (isMaximizing ? score > split.bestScore : score < split.bestScore) {
+                split.bestScore = score;
+                split.bestCell = cell;
+            }
+            if (isMaximizing) {
+                split.alpha = std::max(split.alpha, score);
+            } else {
+                split.beta = std::min(split.beta, score);
+            }
+            if (split.beta <= split.alpha) {
+                split.cutoff.store(true, std::memory_order_relaxed);
+            }
+        });
+
+        // Searches of this node are void as well when the time is up or an enclosing split was cut off.
+        if (checkAborted(context)) {
+            context.aborted = true;
+            return;
+        }
+        alpha = split.alpha;
+        beta = split.beta;
+        bestScore = split.bestScore;
+        bestCell = split.bestCell;
+        if (split.cutoff.load(std::memory_order_relaxed)) {
+            recordCutoff(context, depth, player, bestCell, remainingDepth);
+        }
+    }
+
+    // Searches every move of the root, firstCell first; returns the best score and cell.
+    std::pair<int, int> searchRoot(GameBoard& board, SearchContext& context, const int firstCell) const {
+        Moves moves;
+        if (firstCell != TranspositionTable::NO_MOVE) {
+            moves.push_back(firstCell);
+        }
+        for (Mask empty = getMoves(board); empty != Mask{}; empty = GameBoard::withoutLowest(empty)) {
+            const auto cell = GameBoard::lowestCell(empty);
+            if (cell != firstCell) {
+                moves.push_back(cell);
+            }
+        }
+
+        int bestScore = ALPHA;
+        int bestCell = moves[0];
+        for (std::size_t i = 0; i < moves.size(); ++i) {
+            if (i == 1 && isSplitNode(board, context, 0)) {
+                int alpha = bestScore;
+                int beta = BETA;
+                searchInParallel(board, context, 0, true, moves, i, alpha, beta, bestScore, bestCell,
+                                 getRemainingDepth(context, 0));
+                break;
+            }
+            const auto cell = moves[i];
+            board.move(cell, m_player);
+            // Moves not better than the best so far only need to be proven so.
+            const int currentScore = minimax(board, context, 1, false, bestScore, BETA);
+            board.unmakeMove(cell);
+            if (context.aborted) {
+                break;
+            }
+            if (currentScore > bestScore) {
+                bestScore = currentScore;
+                bestCell = cell;
+            }
+        }
+        return {bestScore, bestCell};
+    }
+
+    // Move order: the move stored for the position, the killers of the ply, then by history.
+    int getMovePriority(const SearchContext& context, const int depth, const char player, const int hashMove,
+                        const int cell) const {
+        if (cell == hashMove) {
+            return std::numeric_limits<int>::max();
+        }
+        if (cell == context.killers[depth][0]) {
+            return std::numeric_limits<int>::max() - 1;
+        }
+        if (cell == context.killers[depth][1]) {
+            return std::numeric_limits<int>::max() - 2;
+        }
+        return context.history[player == m_player ? 0 : 1][cell];
+    }
+
+    static Moves getMoveList(const GameBoard& board) {
+        Moves moves;
+        for (Mask empty = getMoves(board); empty != Mask{}; empty = GameBoard::withoutLowest(empty)) {
+            moves.push_back(GameBoard::lowestCell(empty));
+        }
+        return moves;
+    }
+
+    // Brings the best of the moves from index on to index; a cutoff usually
+    // comes early, so the moves are not sorted up front.
+    int selectNextMove(Moves& moves, const std::size_t index, const SearchContext& context, const int depth,
+                       const char player, const int hashMove) const {
+        auto best = index;
+        auto bestPriority = getMovePriority(context, depth, player, hashMove, moves[index]);
+        for (auto i = index + 1; i < moves.size(); ++i) {
+            const auto priority = getMovePriority(context, depth, player, hashMove, moves[i]);
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                best = i;
+            }
+        }
+        std::swap(moves[index], moves[best]);
+        return moves[index];
+    }
+
+    void recordCutoff(SearchContext& context, const int depth, const char player, const int cell,
+                      const int remainingDepth) const {
+        auto& killers = context.killers[depth];
+        if (killers[0] != cell) {
+            killers[1] = killers[0];
+            killers[0] = cell;
+        }
+        const auto weight = std::min(remainingDepth, GameBoard::CELLS_COUNT);
+        context.history[player == m_player ? 0 : 1][cell] += weight * weight;
+    }
+
+    void store(const GameBoard& board, const int score, const int alpha, const int beta, const int depth,
+               const int cell) const {
+        if (m_table) {
+            m_table->store(board.getHash(), score, TranspositionTable::classify(score, alpha, beta), depth, cell);
         }
     }
 
-private:
     const char m_player;
+    const char m_opponent;
+    const MinMaxOptions m_options;
+    const std::unique_ptr<TranspositionTable> m_table;
+    const std::unique_ptr<ThreadPool> m_pool;
 };
+
+using MinMaxAgent = BasicMinMaxAgent<Board>;
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "game.h"
+#include "agent.h"
+#include "random.h"
+#include "vector_kernels.h"
+
+// One learning step of a network agent: the position before its move and the
+// one after the opponent's reply, as masks. The latter is unused when terminal.
+template <typename GameBoard>
+struct NetworkTransition {
+    typename GameBoard::Mask first;
+    typename GameBoard::Mask second;
+    typename GameBoard::Mask nextFirst;
+    typename GameBoard::Mask nextSecond;
+    int cell;
+    float reward;
+    bool terminal;
+};
+
+// Approximates the Q-values of all cells of a position at once from an encoding
+// with one input per cell and player. With HiddenSize 0 the model is linear in
+// the inputs, otherwise it has one hidden layer of HiddenSize ReLU units.
+// Memory depends on the board size only, not on the positions seen, so the
+// agent fits boards far too large for a Q-table. Inputs are 0 or 1 and mostly 0,
+// so the first layer adds up the weight rows of the occupied cells.
+template <typename GameBoard, int HiddenSize>
+class BasicNetworkAgent final : public BasicAgent<GameBoard> {
+public:
+    using Mask = typename GameBoard::Mask;
+    using Transition = NetworkTransition<GameBoard>;
+
+    constexpr static const int CELLS_COUNT = GameBoard::CELLS_COUNT;
+    constexpr static const int INPUTS_COUNT = 2 * CELLS_COUNT;
+    constexpr static const int HIDDEN_SIZE = HiddenSize;
+    // Rows of values and weights are padded to whole vectors.
+    constexpr static const std::size_t CELLS_STRIDE = paddedToLanes(CELLS_COUNT);
+    constexpr static const std::size_t HIDDEN_STRIDE = paddedToLanes(HiddenSize);
+    // Positions evaluated together: the second layer reads each weight row once per chunk.
+    constexpr static const std::size_t CHUNK_SIZE = 8;
+
+    explicit BasicNetworkAgent(const std::uint64_t seed = Random::DEFAULT_SEED)
+        : m_parameters(PARAMETERS_COUNT, 0)
+        , m_gradients(PARAMETERS_COUNT, 0) {
+        // Small random weights break the ties between cells; padding and biases stay 0.
+        Random random(seed);
+        const auto initialize = [&](const std::size_t offset, const int rows, const std::size_t stride,
+                                    const int columns, const double scale) {
+            for (int row = 0; row < rows; ++row) {
+                for (int column = 0; column < columns; ++column) {
+                    m_parameters[offset + row * stride + column] = float((2 * random.nextUnit() - 1) * scale);
+                }
+            }
+        };
+        initialize(FIRST_WEIGHTS, INPUTS_COUNT, FIRST_STRIDE, FIRST_WIDTH, 1 / std::sqrt(double(CELLS_COUNT)));
+        if constexpr (HiddenSize > 0) {
+            initialize(SECOND_WEIGHTS, CELLS_COUNT, HIDDEN_STRIDE, HiddenSize, 1 / std::sqrt(double(HiddenSize)));
+        }
+    }
+
+    std::size_t getParametersCount() const {
+        return m_parameters.size();
+    }
+
+    std::size_t getMemorySize() const {
+        return (m_parameters.size() + m_gradients.size()) * sizeof(float);
+    }
+
+    // Q-values of all cells of count positions, CELLS_STRIDE floats per position.
+    void evaluate(const GameBoard* games, const std::size_t count, float* qvalues) const {
+        std::array<Mask, CHUNK_SIZE> firsts;
+        std::array<Mask, CHUNK_SIZE> seconds;
+        std::array<float, CHUNK_SIZE * HIDDEN_STRIDE> hidden;
+        for (std::size_t first = 0; first < count; first += CHUNK_SIZE) {
+            const auto chunkSize = std::min(CHUNK_SIZE, count - first);
+            for (std::size_t i = 0; i < chunkSize; ++i) {
+                firsts[i] = games[first + i].getMask(GameBoard::FIRST_PLAYER);
+                seconds[i] = games[first + i].getMask(GameBoard::SECOND_PLAYER);
+            }
+            evaluateChunk(firsts.data(), seconds.data(), chunkSize, hidden.data(), qvalues + first * CELLS_STRIDE);
+        }
+    }
+
+    QAction chooseAction(const GameBoard& game, const double exploration, Random& random) const {
+        if (random.nextUnit() < exploration) {
+            return game.getRandomAction(random);
+        }
+        return chooseAction(game, random);
+    }
+
+    QAction chooseAction(const GameBoard& game, Random&) const override {
+        std::array<float, CELLS_STRIDE> qvalues;
+        evaluate(&game, 1, qvalues.data());
+        return GameBoard::toAction(findBestCell(qvalues.data(), game.getEmptyMask()));
+    }
+
+    void chooseActions(const GameBoard* games, QAction* actions, const std::size_t count, Random&) const override {
+        std::array<float, CHUNK_SIZE * CELLS_STRIDE> qvalues;
+        for (std::size_t first = 0; first < count; first += CHUNK_SIZE) {
+            const auto chunkSize = std::min(CHUNK_SIZE, count - first);
+            evaluate(games + first, chunkSize, qvalues.data());
+            for (std::size_t i = 0; i < chunkSize; ++i) {
+                const auto& game = games[first + i];
+                actions[first + i] = GameBoard::toAction(findBestCell(&qvalues[i * CELLS_STRIDE], game.getEmptyMask()));
+            }
+        }
+    }
+
+    // One step of minibatch SGD on the squared TD errors of count transitions,
+    // all targets taken from the network before the step. Returns the mean absolute TD error.
+    double learn(const Transition* transitions, const std::size_t count, const double learningRate,
+                 const double discount) {
+        if (count == 0) {
+            return 0;
+        }
+        std::array<Mask, CHUNK_SIZE> firsts;
+        std::array<Mask, CHUNK_SIZE> seconds;
+        std::array<float, CHUNK_SIZE> targets;
+        std::array<float, CHUNK_SIZE * HIDDEN_STRIDE> hidden;
+        std::array<float, CHUNK_SIZE * CELLS_STRIDE> qvalues;
+        std::array<float, HIDDEN_STRIDE> hiddenGradient;
+
+        double absoluteErrors = 0;
+        for (std::size_t first = 0; first < count; first += CHUNK_SIZE) {
+            const auto chunkSize = std::min(CHUNK_SIZE, count - first);
+            const auto* chunk = transitions + first;
+
+            for (std::size_t i = 0; i < chunkSize; ++i) {
+                firsts[i] = chunk[i].nextFirst;
+                seconds[i] = chunk[i].nextSecond;
+            }
+            evaluateChunk(firsts.data(), seconds.data(), chunkSize, hidden.data(), qvalues.data());
+            for (std::size_t i = 0; i < chunkSize; ++i) {
+                targets[i] = chunk[i].reward;
+                if (!chunk[i].terminal) {
+                    const auto empty = Mask(~(chunk[i].nextFirst | chunk[i].nextSecond) & GameBoard::FULL_MASK);
+                    const auto cell = findBestCell(&qvalues[i * CELLS_STRIDE], empty);
+                    targets[i] += float(discount) * qvalues[i * CELLS_STRIDE + cell];
+                }
+            }
+
+            for (std::size_t i = 0; i < chunkSize; ++i) {
+                firsts[i] = chunk[i].first;
+                seconds[i] = chunk[i].second;
+            }
+            evaluateChunk(firsts.data(), seconds.data(), chunkSize, hidden.data(), qvalues.data());
+            for (std::size_t i = 0; i < chunkSize; ++i) {
+                const auto cell = chunk[i].cell;
+                const auto error = qvalues[i * CELLS_STRIDE + cell] - targets[i];
+                absoluteErrors += std::abs(error);
+
+                // Gradient of error^2 / 2, which flows through the output of the cell only.
+                if constexpr (HiddenSize > 0) {
+                    const auto* activations = &hidden[i * HIDDEN_STRIDE];
+                    addScaled(&m_gradients[SECOND_WEIGHTS + cell * HIDDEN_STRIDE], activations, error, HIDDEN_STRIDE);
+                    m_gradients[SECOND_BIAS + cell] += error;
+                    scaleWhereActive(hiddenGradient.data(), &m_parameters[SECOND_WEIGHTS + cell * HIDDEN_STRIDE], error,
+                                     activations, HIDDEN_STRIDE);
+                    addVector(&m_gradients[FIRST_BIAS], hiddenGradient.data(), FIRST_STRIDE);
+                    forEachInput(firsts[i], seconds[i], [&](const int input) {
+                        addVector(&m_gradients[FIRST_WEIGHTS + input * FIRST_STRIDE], hiddenGradient.data(), FIRST_STRIDE);
+                    });
+                } else {
+                    m_gradients[FIRST_BIAS + cell] += error;
+                    forEachInput(firsts[i], seconds[i], [&](const int input) {
+                        m_gradients[FIRST_WEIGHTS + input * FIRST_STRIDE + cell] += error;
+                    });
+                }
+            }
+        }
+
+        addScaled(m_parameters.data(), m_gradients.data(), float(-learningRate / double(count)), m_parameters.size());
+        std::fill(m_gradients.begin(), m_gradients.end(), 0.0f);
+        return absoluteErrors / double(count);
+    }
+
+private:
+    // The first layer computes the hidden units, or directly the Q-values of the linear model.
+    constexpr static const int FIRST_WIDTH = HiddenSize > 0 ? HiddenSize : CELLS_COUNT;
+    constexpr static const std::size_t FIRST_STRIDE = HiddenSize > 0 ? HIDDEN_STRIDE : CELLS_STRIDE;
+
+    // Offsets of the weight rows and biases of both layers in m_parameters.
+    constexpr static const std::size_t FIRST_WEIGHTS = 0;
+    constexpr static const std::size_t FIRST_BIAS = FIRST_WEIGHTS + INPUTS_COUNT * FIRST_STRIDE;
+    constexpr static const std::size_t SECOND_WEIGHTS = FIRST_BIAS + FIRST_STRIDE;
+    constexpr static const std::size_t SECOND_BIAS = SECOND_WEIGHTS + CELLS_COUNT * HIDDEN_STRIDE;
+    constexpr static const std::size_t PARAMETERS_COUNT = HiddenSize > 0 ? SECOND_BIAS + CELLS_STRIDE : SECOND_WEIGHTS;
+
+    // Inputs [0, CELLS_COUNT) are the cells of the first player, the rest those of the second.
+    template <typename Visitor>
+    static void forEachInput(const Mask first, const Mask second, Visitor&& visitor) {
+        for (Mask rest = first; rest != Mask{}; rest = GameBoard::withoutLowest(rest)) {
+            visitor(GameBoard::lowestCell(rest));
+        }
+        for (Mask rest = second; rest != Mask{}; rest = GameBoard::withoutLowest(rest)) {
+            visitor(CELLS_COUNT + GameBoard::lowestCell(rest));
+        }
+    }
+
+    // Highest valued cell of a non-empty mask.
+    static int findBestCell(const float* qvalues, Mask empty) {
+        auto bestCell = GameBoard::lowestCell(empty);
+        for (empty = GameBoard::withoutLowest(empty); empty != Mask{}; empty = GameBoard::withoutLowest(empty)) {
+            const auto cell = GameBoard::lowestCell(empty);
+            if (qvalues[cell] > qvalues[bestCell]) {
+                bestCell = cell;
+            }
+        }
+        return bestCell;
+    }
+
+    // Q-values of at most CHUNK_SIZE positions; hidden receives their hidden units.
+    void evaluateChunk(const Mask* firsts, const Mask* seconds, const std::size_t count, float* hidden,
+                       float* qvalues) const {
+        const auto* parameters = m_parameters.data();
+        for (std::size_t i = 0; i < count; ++i) {
+            float* output;
+            if constexpr (HiddenSize > 0) {
+                output = hidden + i * HIDDEN_STRIDE;
+            } else {
+                output = qvalues + i * CELLS_STRIDE;
+            }
+            std::copy(parameters + FIRST_BIAS, parameters + FIRST_BIAS + FIRST_STRIDE, output);
+            forEachInput(firsts[i], seconds[i], [&](const int input) {
+                addVector(output, parameters + FIRST_WEIGHTS + input * FIRST_STRIDE, FIRST_STRIDE);
+            });
+        }
+        if constexpr (HiddenSize > 0) {
+            for (std::size_t i = 0; i < count; ++i) {
+                applyRelu(hidden + i * HIDDEN_STRIDE, HIDDEN_STRIDE);
+            }
+            for (int cell = 0; cell < CELLS_COUNT; ++cell) {
+                const auto* weights = parameters + SECOND_WEIGHTS + cell * HIDDEN_STRIDE;
+                const auto bias = parameters[SECOND_BIAS + cell];
+                for (std::size_t i = 0; i < count; ++i) {
+                    qvalues[i * CELLS_STRIDE + cell] = bias + dotProduct(weights, hidden + i * HIDDEN_STRIDE, HIDDEN_STRIDE);
+                }
+            }
+        }
+    }
+
+    std::vector<float> m_parameters;
+    // Sum of the gradients of the current minibatch, same layout as m_parameters.
+    std::vector<float> m_gradients;
+};
+
+using LinearAgent = BasicNetworkAgent<Board, 0>;
+using MlpAgent = BasicNetworkAgent<Board, 64>;
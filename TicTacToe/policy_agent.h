@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <optional>
+#include <utility>
+#include <cstddef>
+
+#include "game.h"
+#include "agent.h"
+#include "random.h"
+#include "qvalues_agent.h"
+#include "checkpoint.h"
+
+// Greedy policy frozen from a trained Q-values agent: the mask of best actions
+// of every Board::State, in the frame of the position itself, so a move is one
+// table read and no symmetry or value lookups. The table is immutable and
+// takes 2 bytes per state. Ties are broken uniformly at random, positions the
+// agent never learned are played at random, as the agent does.
+class FrozenPolicyAgent final : public Agent {
+public:
+    template <typename QTable>
+    explicit FrozenPolicyAgent(const BasicQValuesAgent<QTable>& agent) : m_frozen(Board::STATES_COUNT, 0) {
+        for (int state = 0; state < Board::STATES_COUNT; ++state) {
+            m_frozen[state] = agent.getBestActions(Board::fromState(Board::State(state)));
+        }
+        m_bestActions = m_frozen.data();
+    }
+
+    // Serves the best actions stored in a checkpoint in place, nothing is
+    // computed; the table must have them (see MappedQTable::getBestActionsBlock()).
+    explicit FrozenPolicyAgent(MappedQTable&& table)
+        : m_table(std::move(table))
+        , m_bestActions(m_table->getBestActionsBlock()) {}
+
+    // The policy may point into the agent's own storage.
+    FrozenPolicyAgent(const FrozenPolicyAgent&) = delete;
+    FrozenPolicyAgent& operator=(const FrozenPolicyAgent&) = delete;
+
+    QAction chooseAction(const Board& game, Random& random) const override {
+        // Masked with the empty cells as the masks of a mapped checkpoint are not checked.
+        const auto empty = game.getEmptyMask();
+        const auto best = Board::Mask(m_bestActions[game.getState()] & empty);
+        return Board::toAction(Board::getRandomCell(best ? best : empty, random));
+    }
+
+    Board::Mask getBestActions(const Board::State state) const {
+        return m_bestActions[state];
+    }
+
+    std::size_t getMemorySize() const {
+        return m_frozen.size() * sizeof(Board::Mask);
+    }
+
+private:
+    std::vector<Board::Mask> m_frozen;
+    std::optional<MappedQTable> m_table;
+    const Board::Mask* m_bestActions = nullptr;
+};
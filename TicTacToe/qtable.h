@@ -0,0 +1,177 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <atomic>
+
+#include "game.h"
+
+struct pairhash {
+public:
+    template <typename T, typename U>
+    std::size_t operator()(const std::pair<T, U> &x) const
+    {
+        return std::hash<T>()(x.first) ^ std::hash<U>()(x.second);
+    }
+};
+
+// Both tables expose the same interface so QValuesAgent can be built on either:
+// getKnownActions() is the mask of cells that have a learned value in the state,
+// getMaxValue() is the largest learned value of the state clamped from below by 0,
+// prefetch() hints that the values of the state are about to be read.
+// size() is the number of states with at least one learned value, whatever
+// the backend; checkpoints store it as learnedStates and telemetry reports it.
+// CONCURRENT tells whether several threads may update the table at once.
+
+// The original string-keyed table, kept for comparison with DenseQTable.
+class MapQTable final {
+    using QValues = std::unordered_map<QAction, QValue, pairhash>;
+    using QTable = std::unordered_map<std::string, QValues>;
+
+public:
+    constexpr static const bool CONCURRENT = false;
+
+    Board::Mask getKnownActions(const Board::State state) const {
+        Board::Mask known = 0;
+        const auto qValuesIter = m_qtable.find(Board::fromState(state).toString());
+        if (qValuesIter != m_qtable.cend()) {
+            for (const auto& qValue : qValuesIter->second) {
+                known |= Board::Mask(1 << Board::toCell(qValue.first));
+            }
+        }
+        return known;
+    }
+
+    QValue getValue(const Board::State state, const int cell) const {
+        const auto qValuesIter = m_qtable.find(Board::fromState(state).toString());
+        if (qValuesIter == m_qtable.cend()) {
+            return 0;
+        }
+        const auto qValueIter = qValuesIter->second.find(Board::toAction(cell));
+        return qValueIter != qValuesIter->second.cend() ? qValueIter->second : 0;
+    }
+
+    QValue getMaxValue(const Board::State state) const {
+        double maxQValue = 0;
+        const auto qValuesIter = m_qtable.find(Board::fromState(state).toString());
+        if (qValuesIter != m_qtable.cend()) {
+            for (const auto& qValue : qValuesIter->second) {
+                maxQValue = std::max(maxQValue, qValue.second);
+            }
+        }
+        return maxQValue;
+    }
+
+    void setValue(const Board::State state, const int cell, const QValue value) {
+        m_qtable[Board::fromState(state).toString()][Board::toAction(cell)] = value;
+    }
+
+    void prefetch(const Board::State) const {}
+
+    std::size_t size() const {
+        return m_qtable.size();
+    }
+
+    // Calls visitor(state, cell, value) for every learned value.
+    template <typename Visitor>
+    void forEach(Visitor&& visitor) const {
+        for (const auto& entry : m_qtable) {
+            Board board;
+            for (int cell = 0; cell < Board::CELLS_COUNT; ++cell) {
+                if (entry.first[cell] != Board::EMPTY_CELL) {
+                    board.move(cell, entry.first[cell]);
+                }
+            }
+            for (const auto& qValue : entry.second) {
+                visitor(board.getState(), Board::toCell(qValue.first), qValue.second);
+            }
+        }
+    }
+
+private:
+    QTable m_qtable;
+};
+
+// Flat table indexed by Board::State with one row of CELLS_COUNT values per state.
+// Values are relaxed atomics: concurrent trainers update it Hogwild-style,
+// a racing read-modify-write may lose an update but never tears a value.
+class DenseQTable final {
+    struct Row {
+        std::array<std::atomic<QValue>, Board::CELLS_COUNT> values;
+        std::atomic<Board::Mask> known;
+    };
+
+public:
+    constexpr static const bool CONCURRENT = true;
+
+    DenseQTable() : m_rows(Board::STATES_COUNT) {
+        for (auto& row : m_rows) {
+            for (auto& value : row.values) {
+                value.store(0, std::memory_order_relaxed);
+            }
+            row.known.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    Board::Mask getKnownActions(const Board::State state) const {
+        return state < Board::STATES_COUNT ? m_rows[state].known.load(std::memory_order_relaxed) : 0;
+    }
+
+    QValue getValue(const Board::State state, const int cell) const {
+        return m_rows[state].values[cell].load(std::memory_order_relaxed);
+    }
+
+    QValue getMaxValue(const Board::State state) const {
+        if (state >= Board::STATES_COUNT) {
+            return 0;
+        }
+        // Unknown actions hold 0, so they don't affect the clamped maximum.
+        QValue maxQValue = 0;
+        for (const auto& value : m_rows[state].values) {
+            maxQValue = std::max(maxQValue, value.load(std::memory_order_relaxed));
+        }
+        return maxQValue;
+    }
+
+    // A row spans two cache lines.
+    void prefetch(const Board::State state) const {
+        if (state < Board::STATES_COUNT) {
+            prefetchMemory(&m_rows[state].values.front());
+            prefetchMemory(&m_rows[state].known);
+        }
+    }
+
+    void setValue(const Board::State state, const int cell, const QValue value) {
+        auto& row = m_rows[state];
+        row.values[cell].store(value, std::memory_order_relaxed);
+        const auto bit = Board::Mask(1 << cell);
+        if (!(row.known.load(std::memory_order_relaxed) & bit)) {
+            // The first learned action of a state counts the state, as MapQTable counts its rows.
+            if (row.known.fetch_or(bit, std::memory_order_relaxed) == 0) {
+                m_size.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::size_t size() const {
+        return m_size.load(std::memory_order_relaxed);
+    }
+
+    template <typename Visitor>
+    void forEach(Visitor&& visitor) const {
+        for (int state = 0; state < Board::STATES_COUNT; ++state) {
+            const auto& row = m_rows[state];
+            for (Board::Mask known = row.known.load(std::memory_order_relaxed); known; known &= known - 1) {
+                const auto cell = Board::lowestCell(known);
+                visitor(Board::State(state), cell, row.values[cell].load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+private:
+    std::vector<Row> m_rows;
+    std::atomic<std::size_t> m_size{0};
+};
@@ -1,40 +1,38 @@
+#pragma once
+
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <algorithm>
 #include <ctime>
 #include <cstdlib>
 #include <limits>
 #include <sstream>
+#include <array>
 
 #include "game.h"
 #include "agent.h"
-
-struct pairhash {
-public:
-    template <typename T, typename U>
-    std::size_t operator()(const std::pair<T, U> &x) const
-    {
-        return std::hash<T>()(x.first) ^ std::hash<U>()(x.second);
-    }
-};
+#include "qtable.h"
+#include "symmetry.h"
 
 inline std::ostream& operator<<(std::ostream& ss, const QAction& action) {
     ss << "(" << action.first << ", " << action.second << ")";
     return ss;
 }
 
-class QValuesAgent final : public Agent {
-    using QValues = std::unordered_map<QAction, QValue, pairhash>;
-    using BoardState = std::string;
-    using QTable = std::unordered_map<BoardState, QValues>;
-
+// QTable is the storage backend, see qtable.h.
+template <typename QTable>
+class BasicQValuesAgent final : public Agent {
     static std::ostream& printBoardFromString(std::ostream& ss, const std::string& boardString) {
-        for (int i = 0; i < 9; ++i) {
-            if (i % 3 == 0 && i != 0) {
+        for (int i = 0; i < Board::CELLS_COUNT; ++i) {
+            if (i % Board::BOARD_SIZE == 0 && i != 0) {
+                ss << std::endl;
+                for (int j = 0; j < Board::BOARD_SIZE; ++j) {
+                    ss << (j ? " -" : "-");
+                }
                 ss << std::endl;
-                ss << "- - - - -" << std::endl;
             }
-            if (i % 3 != 0) {
+            if (i % Board::BOARD_SIZE != 0) {
                 ss << " | ";
             }
             ss << boardString[i];
@@ -43,117 +41,240 @@ class QValuesAgent final : public Agent {
         return ss;
     }
 
-    static QActionList getBestFromAvailable(const QActionList& available, const QValues& values) {
-        QValues availableValues;
-        for(const auto& action: available) {
-            const auto qValueIter = values.find(action);
-            if(qValueIter != values.cend()) {
-                availableValues.emplace(qValueIter->first, qValueIter->second);
-            }
-        }
+    // Position and action as they are stored in the table: with symmetric states
+    // both are brought to the canonical frame, otherwise they are kept as is.
+    Board::State getTableState(const Board::State state) const {
+        return m_symmetric && state != Board::NO_STATE ? Symmetry::canonicalize(state).state : state;
+    }
 
-        QActionList bestValues;
-        const auto elemIter = std::max_element(availableValues.cbegin(), availableValues.cend(), [](const QValues::value_type& left,
-                                                                                                    const QValues::value_type& right) {
-            return left.second < right.second;
-        });
-        for(const auto value: availableValues) {
-            if(value.second == elemIter->second) {
-                bestValues.emplace_back(value.first);
-            }
+    int getTableCell(const Board::State state, const int cell) const {
+        if (!m_symmetric) {
+            return cell;
         }
+        const auto& canonical = Symmetry::canonicalize(state);
+        return Symmetry::canonicalCell(Symmetry::transformCell(cell, canonical.transform), canonical.stabilizer);
+    }
+
+    // A position in the frame of the table and the transform that brought it there.
+    struct TablePosition {
+        Board::State state;
+        Board::Mask empty;
+        Symmetry::Transform transform;
+    };
 
-        if(bestValues.empty()) {
-            return available;
+    TablePosition getTablePosition(const Board& game) const {
+        TablePosition position{game.getState(), game.getEmptyMask(), Symmetry::IDENTITY};
+        if (m_symmetric) {
+            const auto& canonical = Symmetry::canonicalize(position.state);
+            position.state = canonical.state;
+            position.transform = canonical.transform;
+            position.empty = Symmetry::transformMask(position.empty, position.transform);
         }
+        return position;
+    }
 
-        return bestValues;
+    QAction findBestOrRandomAvailableAction(const Board& game, Random& random) const
+    {
+        return findBestOrRandomAvailableAction(game, getTablePosition(game), random);
     }
 
-    QAction findBestOrRandomAvailableAction(const Board& game) const
+    // Picks uniformly among the best learned available actions,
+    // or among all available actions when none of them was learned yet.
+    QAction findBestOrRandomAvailableAction(const Board& game, const TablePosition& position, Random& random) const
     {
-        const auto state = game.toString();
-        const auto qValuesIter = m_qtable.find(state);
-        const auto& availableActions = game.getAvailableActions();
-        if(qValuesIter != m_qtable.cend()) {
-            const auto& qValues = getBestFromAvailable(availableActions, qValuesIter->second);
-            return qValues[rand() % qValues.size()];
-        } else {
-            return availableActions[rand() % availableActions.size()];
+        const auto state = position.state;
+        const auto known = Board::Mask(m_qtable.getKnownActions(state) & position.empty);
+        if (!known) {
+            return game.getRandomAction(random);
+        }
+
+        std::array<int, Board::CELLS_COUNT> bestCells;
+        int bestCount = 0;
+        QValue bestValue = std::numeric_limits<QValue>::lowest();
+        for (Board::Mask rest = known; rest; rest &= rest - 1) {
+            const auto cell = Board::lowestCell(rest);
+            const auto value = m_qtable.getValue(state, cell);
+            if (value > bestValue) {
+                bestValue = value;
+                bestCount = 0;
+            }
+            if (value == bestValue) {
+                bestCells[bestCount++] = cell;
+            }
         }
+        const auto cell = bestCells[random.nextIndex(bestCount)];
+        return Board::toAction(Symmetry::transformCell(cell, Symmetry::inverse(position.transform)));
     }
 
 public:
+    // With symmetric states rotated and reflected positions share one table entry.
+    explicit BasicQValuesAgent(const bool symmetric = true) : m_symmetric(symmetric) {}
+
+    // Serves or continues learning from a table filled elsewhere, e.g. a loaded checkpoint.
+    BasicQValuesAgent(QTable&& qtable, const bool symmetric)
+        : m_qtable(std::move(qtable))
+        , m_symmetric(symmetric) {}
+
+    const QTable& getTable() const {
+        return m_qtable;
+    }
+
+    bool isSymmetric() const {
+        return m_symmetric;
+    }
+
+    // Copies the values of source, anything with forEach(visitor(state, cell, value))
+    // such as a Solver, mapping states and cells as learning does.
+    template <typename Source>
+    void seed(const Source& source) {
+        source.forEach([&](const Board::State state, const int cell, const QValue value) {
+            m_qtable.setValue(getTableState(state), getTableCell(state, cell), value);
+        });
+    }
+
+    // Available actions of the game whose learned value is the best one, in the frame of
+    // the game: with symmetric states all cells equivalent to a best one are included.
+    // Empty when none of the available actions was learned yet.
+    Board::Mask getBestActions(const Board& game) const {
+        const auto state = game.getState();
+        const auto tableState = getTableState(state);
+        const auto known = m_qtable.getKnownActions(tableState);
+        Board::Mask best = 0;
+        QValue bestValue = std::numeric_limits<QValue>::lowest();
+        for (Board::Mask empty = game.getEmptyMask(); empty; empty &= empty - 1) {
+            const auto cell = Board::lowestCell(empty);
+            const auto tableCell = getTableCell(state, cell);
+            if (!(known & (1 << tableCell))) {
+                continue;
+            }
+            const auto value = m_qtable.getValue(tableState, tableCell);
+            if (value > bestValue) {
+                bestValue = value;
+                best = 0;
+            }
+            if (value == bestValue) {
+                best |= Board::Mask(1 << cell);
+            }
+        }
+        return best;
+    }
+
     void printAlternatives(const Board& game) const
     {
-        const auto state = game.toString();
-        const auto qValuesIter = m_qtable.find(state);
-        if(qValuesIter != m_qtable.cend()) {
-            for(const auto action : qValuesIter->second) {
-                std::cout << action.first << " - " << action.second
-                          << std::endl;
-            }
+        const auto state = getTableState(game.getState());
+        const auto transform = m_symmetric ? Symmetry::canonicalize(game.getState()).transform : Symmetry::IDENTITY;
+        for (Board::Mask known = m_qtable.getKnownActions(state); known; known &= known - 1) {
+            const auto cell = Board::lowestCell(known);
+            std::cout << Board::toAction(Symmetry::transformCell(cell, Symmetry::inverse(transform)))
+                      << " - " << m_qtable.getValue(state, cell)
+                      << std::endl;
         }
     }
 
-    std::pair<int, int> chooseAction(const Board& game, const double exploration) {
+    std::pair<int, int> chooseAction(const Board& game, const double exploration, Random& random) {
         std::pair<int, int> action;
-        if (rand() / static_cast<double>(RAND_MAX) < exploration) {
-            action = game.getRandomAction();
+        if (random.nextUnit() < exploration) {
+            action = game.getRandomAction(random);
         } else {
-            action = findBestOrRandomAvailableAction(game);
+            action = findBestOrRandomAvailableAction(game, random);
         }
         return action;
     }
 
-    std::pair<int, int> chooseAction(const Board& game) const override {
-        return findBestOrRandomAvailableAction(game);
+    std::pair<int, int> chooseAction(const Board& game, Random& random) const override {
+        return findBestOrRandomAvailableAction(game, random);
+    }
+
+    // Positions are brought to the table frame and their rows prefetched a chunk
+    // at a time, so the table reads of a chunk overlap instead of queueing up.
+    void chooseActions(const Board* games, QAction* actions, const std::size_t count, Random& random) const override {
+        constexpr std::size_t CHUNK_SIZE = 32;
+        std::array<TablePosition, CHUNK_SIZE> positions;
+        for (std::size_t first = 0; first < count; first += CHUNK_SIZE) {
+            const auto chunkSize = std::min(CHUNK_SIZE, count - first);
+            for (std::size_t i = 0; i < chunkSize; ++i) {
+                positions[i] = getTablePosition(games[first + i]);
+                m_qtable.prefetch(positions[i].state);
+            }
+            for (std::size_t i = 0; i < chunkSize; ++i) {
+                actions[first + i] = findBestOrRandomAvailableAction(games[first + i], positions[i], random);
+            }
+        }
     }
 
-    void updateQValues(const std::string& state,
-                       const std::string& nextState,
+    // nextState is Board::NO_STATE for terminal transitions.
+    // Returns the change applied to the Q-value.
+    QValue updateQValues(const Board::State state,
+                       const Board::State nextState,
                        const std::pair<int, int>& action,
                        const double reward,
                        const double learningRate,
                        const double discount) {
-        auto& qValues = m_qtable[state];
-        auto& qValue = qValues[action];
-
-        double maxQValue = 0;
-        const auto qNextValuesIter = m_qtable.find(nextState);
-        if(qNextValuesIter != m_qtable.cend()) {
-            const auto& qNextValues = qNextValuesIter->second;
-            for (const auto& qNextValue : qNextValues) {
-                maxQValue = std::max(maxQValue, qNextValue.second);
-            }
-        }
+        const auto tableState = getTableState(state);
+        const auto cell = getTableCell(state, Board::toCell(action));
+        auto qValue = m_qtable.getValue(tableState, cell);
+
+        const double maxQValue = m_qtable.getMaxValue(getTableState(nextState));
 
         qValue += learningRate * reward;
 
         if(maxQValue != 0) {
             qValue += learningRate* (discount * maxQValue - qValue);
         }
+
+        const auto update = qValue - m_qtable.getValue(tableState, cell);
+        m_qtable.setValue(tableState, cell, qValue);
+        return update;
+    }
+
+    QValue getQValue(const Board::State state, const QAction& action) const {
+        return m_qtable.getValue(getTableState(state), getTableCell(state, Board::toCell(action)));
+    }
+
+    // Largest learned value of the state clamped from below by 0, 0 for Board::NO_STATE.
+    QValue getMaxQValue(const Board::State state) const {
+        return m_qtable.getMaxValue(getTableState(state));
+    }
+
+    // Moves the Q-value by learningRate * error; returns the change applied.
+    QValue addQValueError(const Board::State state, const QAction& action, const double error, const double learningRate) {
+        const auto tableState = getTableState(state);
+        const auto cell = getTableCell(state, Board::toCell(action));
+        const auto qValue = m_qtable.getValue(tableState, cell);
+        const auto update = learningRate * error;
+        m_qtable.setValue(tableState, cell, qValue + update);
+        return update;
     }
 
     void print(std::ostream& ss) const {
         ss << "Q-table: " << m_qtable.size() << std::endl;
-        for (const auto& entry : m_qtable) {
-            ss << entry.first << std::endl;
-            printBoardFromString(ss, entry.first);
-            for(const auto action : entry.second) {
-                ss << action.first << " - " << action.second
-                          << std::endl;
+        auto lastState = Board::NO_STATE;
+        m_qtable.forEach([&](const Board::State state, const int cell, const QValue value) {
+            if (state != lastState) {
+                const auto boardString = Board::fromState(state).toString();
+                ss << boardString << std::endl;
+                printBoardFromString(ss, boardString);
+                lastState = state;
             }
-        }
+            ss << Board::toAction(cell) << " - " << value
+                      << std::endl;
+        });
     }
 
 private:
     QTable m_qtable;
+    const bool m_symmetric;
 };
 
-class RandomAgent final : public Agent {
+using QValuesAgent = BasicQValuesAgent<DenseQTable>;
+using MapQValuesAgent = BasicQValuesAgent<MapQTable>;
+
+template <typename GameBoard>
+class BasicRandomAgent final : public BasicAgent<GameBoard> {
 public:
-    QAction chooseAction(const Board& game) const override {
-        return game.getRandomAction();
+    QAction chooseAction(const GameBoard& game, Random& random) const override {
+        return game.getRandomAction(random);
     }
 };
+
+using RandomAgent = BasicRandomAgent<Board>;
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+// xoshiro256** generator. It is passed explicitly to everything that needs
+// randomness, so each agent, thread or evaluation shard owns its stream and a
+// run is reproduced bit-for-bit from its seed. Satisfies UniformRandomBitGenerator.
+class Random final {
+public:
+    using result_type = std::uint64_t;
+
+    constexpr static const std::uint64_t DEFAULT_SEED = 0x7A1C7AC70EULL;
+
+    // Streams with different numbers are seeded through splitmix64 and don't
+    // share state; use jump() when provably disjoint sequences are required.
+    explicit Random(const std::uint64_t seed = DEFAULT_SEED, const std::uint64_t stream = 0) {
+        std::uint64_t mixer = seed ^ (stream * 0xD1342543DE82EF95ULL);
+        for (auto& word : m_state) {
+            word = splitMix64(mixer);
+        }
+    }
+
+    constexpr static result_type min() {
+        return 0;
+    }
+
+    constexpr static result_type max() {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    result_type operator()() {
+        const auto result = rotl(m_state[1] * 5, 7) * 9;
+        const auto t = m_state[1] << 17;
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 45);
+        return result;
+    }
+
+    // Uniform integer in [0, count) without modulo bias (Lemire's method).
+    std::uint32_t nextIndex(const std::uint32_t count) {
+        auto product = std::uint64_t(std::uint32_t((*this)() >> 32)) * count;
+        auto low = std::uint32_t(product);
+        if (low < count) {
+            const auto threshold = std::uint32_t(-count) % count;
+            while (low < threshold) {
+                product = std::uint64_t(std::uint32_t((*this)() >> 32)) * count;
+                low = std::uint32_t(product);
+            }
+        }
+        return std::uint32_t(product >> 32);
+    }
+
+    // Uniform real in [0, 1).
+    double nextUnit() {
+        return ((*this)() >> 11) * 0x1.0p-53;
+    }
+
+    // Advances the generator by 2^128 steps.
+    void jump() {
+        constexpr std::uint64_t JUMP[] = {0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL,
+                                          0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL};
+        std::uint64_t state[4] = {0, 0, 0, 0};
+        for (const auto word : JUMP) {
+            for (int bit = 0; bit < 64; ++bit) {
+                if (word & (std::uint64_t(1) << bit)) {
+                    for (int i = 0; i < 4; ++i) {
+                        state[i] ^= m_state[i];
+                    }
+                }
+                (*this)();
+            }
+        }
+        for (int i = 0; i < 4; ++i) {
+            m_state[i] = state[i];
+        }
+    }
+
+private:
+    static std::uint64_t rotl(const std::uint64_t x, const int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    static std::uint64_t splitMix64(std::uint64_t& state) {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    std::uint64_t m_state[4];
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "game.h"
+#include "random.h"
+
+// One learning step as BasicQValuesAgent::updateQValues() takes it, packed in 12 bytes.
+// nextState is Board::NO_STATE for terminal transitions.
+struct Transition {
+    Board::State state;
+    Board::State nextState;
+    std::int8_t cell;
+    float reward;
+};
+
+static_assert(sizeof(Transition) <= 12, "transitions are stored by the hundred thousand");
+
+struct ReplayOptions {
+    std::size_t capacity = 1 << 16;
+    // Transitions replayed per transition recorded; above 1 every one is learned from several times.
+    double replayRatio = 1.0;
+    // Replayed transitions are applied in order of state, so updates of a state run back to back.
+    // Only pays off for tables that don't fit in cache: updates of one value depend on each
+    // other, so on the 3x3 table sorted batches run slower than random ones.
+    bool sortByState = false;
+    // Sample transitions in proportion to (|TD error| + MIN_PRIORITY)^priorityExponent instead of uniformly.
+    bool prioritized = false;
+    double priorityExponent = 0.6;
+    // Prioritized updates are scaled by the importance-sampling weight (N * P(i))^-importanceExponent
+    // over the largest weight in the buffer: 1 corrects the bias of the sampling fully, 0 not at all.
+    double importanceExponent = 0.4;
+};
+
+// Binary tree of sums and minimums over the leaf priorities: setting a priority
+// and finding the leaf at a given prefix sum both take O(log capacity).
+// Leaves never set count as 0 in sums and are left out of the minimum.
+class PriorityTree final {
+public:
+    explicit PriorityTree(const std::size_t capacity) : m_leavesCount(1) {
+        while (m_leavesCount < capacity) {
+            m_leavesCount *= 2;
+        }
+        m_sums.assign(2 * m_leavesCount, 0);
+        m_minimums.assign(2 * m_leavesCount, std::numeric_limits<double>::infinity());
+    }
+
+    double getTotal() const {
+        return m_sums[1];
+    }
+
+    double getMinimum() const {
+        return m_minimums[1];
+    }
+
+    double get(const std::size_t index) const {
+        return m_sums[m_leavesCount + index];
+    }
+
+    // Sums are recomputed from the children, so rounding errors don't accumulate.
+    void set(const std::size_t index, const double priority) {
+        auto node = m_leavesCount + index;
+        m_sums[node] = priority;
+        m_minimums[node] = priority;
+        for (node /= 2; node > 0; node /= 2) {
+            m_sums[node] = m_sums[2 * node] + m_sums[2 * node + 1];
+            m_minimums[node] = std::min(m_minimums[2 * node], m_minimums[2 * node + 1]);
+        }
+    }
+
+    // Leaf where the running sum of priorities exceeds value, a value in [0, getTotal()).
+    std::size_t find(double value) const {
+        std::size_t node = 1;
+        while (node < m_leavesCount) {
+            if (value < m_sums[2 * node]) {
+                node = 2 * node;
+            } else {
+                value -= m_sums[2 * node];
+                node = 2 * node + 1;
+            }
+        }
+        return node - m_leavesCount;
+    }
+
+private:
+    std::size_t m_leavesCount;
+    std::vector<double> m_sums;
+    std::vector<double> m_minimums;
+};
+
+// Ring buffer of the latest transitions of a trainer; once full, every new
+// transition replaces the oldest one. Storage is allocated by the constructor.
+class ReplayBuffer final {
+public:
+    // Keeps transitions with a zero TD error in the sample.
+    constexpr static const double MIN_PRIORITY = 1e-3;
+
+    explicit ReplayBuffer(const ReplayOptions& options)
+        : m_transitions(std::max<std::size_t>(1, options.capacity))
+        , m_prioritized(options.prioritized)
+        , m_priorityExponent(options.priorityExponent)
+        , m_importanceExponent(options.importanceExponent)
+        , m_priorities(m_prioritized ? m_transitions.size() : 0) {}
+
+    std::size_t size() const {
+        return m_size;
+    }
+
+    std::size_t capacity() const {
+        return m_transitions.size();
+    }
+
+    const Transition& operator[](const std::size_t index) const {
+        return m_transitions[index];
+    }
+
+    // New transitions get the highest priority seen, so each is replayed soon at least once.
+    void add(const Transition& transition) {
+        m_transitions[m_next] = transition;
+        if (m_prioritized) {
+            m_priorities.set(m_next, m_maxPriority);
+        }
+        m_next = m_next + 1 == capacity() ? 0 : m_next + 1;
+        m_size = std::min(m_size + 1, capacity());
+    }
+
+    // Index of a random transition; the buffer must not be empty.
+    std::size_t sample(Random& random) const {
+        if (!m_prioritized) {
+            return random.nextIndex(std::uint32_t(m_size));
+        }
+        return std::min(m_priorities.find(random.nextUnit() * m_priorities.getTotal()), m_size - 1);
+    }
+
+    // Factor of the learning rate of a sampled transition, 1 for uniform sampling.
+    // P(i) is priority / total, so the normalized weight (N * P(i))^-beta / (N * P_min)^-beta
+    // is (minimum priority / priority)^beta, all in (0, 1].
+    double getWeight(const std::size_t index) const {
+        if (!m_prioritized) {
+            return 1.0;
+        }
+        return std::pow(m_priorities.getMinimum() / m_priorities.get(index), m_importanceExponent);
+    }
+
+    // Records the TD error of a replayed transition, which sets how often it is sampled.
+    void setError(const std::size_t index, const double error) {
+        if (!m_prioritized) {
+            return;
+        }
+        const auto priority = std::pow(std::abs(error) + MIN_PRIORITY, m_priorityExponent);
+        m_maxPriority = std::max(m_maxPriority, priority);
+        m_priorities.set(index, priority);
+    }
+
+private:
+    std::vector<Transition> m_transitions;
+    std::size_t m_next = 0;
+    std::size_t m_size = 0;
+
+    const bool m_prioritized;
+    const double m_priorityExponent;
+    const double m_importanceExponent;
+    PriorityTree m_priorities;
+    double m_maxPriority = 1.0;
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstddef>
+
+#include "game.h"
+#include "agent.h"
+#include "random.h"
+
+// Reward given at the end of a game, as in the learning episodes:
+// Aggressive is Board::getAggressiveReward(), Defensive is Board::getDefensiveReward(),
+// and a loss is always -1.
+enum class RewardShaping {
+    Aggressive,
+    Defensive
+};
+
+// How the opponent is assumed to move: minimizing the player's return or uniformly at random.
+enum class OpponentModel {
+    Optimal,
+    Uniform
+};
+
+// How far a policy is from the solver's optimal one over all decision states.
+struct OptimalityGap {
+    int states = 0;
+    int suboptimalStates = 0;
+    double meanRegret = 0;
+    double maxRegret = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& ss, const OptimalityGap& gap) {
+    ss << "Suboptimal: " << gap.suboptimalStates << " of " << gap.states << " states, regret mean "
+       << gap.meanRegret << " max " << gap.maxRegret << std::endl;
+    return ss;
+}
+
+// Exact solver for one player: walks every position reachable from the empty
+// board once, memoized by Board::State, and computes the optimal Q-value of
+// every action of the player, the return of an episode that takes the action
+// and plays optimally afterwards, discounted per own move.
+class Solver final {
+public:
+    Solver(const char player, const RewardShaping rewards, const OpponentModel opponentModel, const double discount = 1.0)
+        : m_player(player)
+        , m_opponent(getOponent(player))
+        , m_rewards(rewards)
+        , m_opponentModel(opponentModel)
+        , m_discount(discount)
+        , m_solved(Board::STATES_COUNT, false)
+        , m_values(Board::STATES_COUNT, 0)
+        , m_actions(Board::STATES_COUNT, 0)
+        , m_qvalues(std::size_t(Board::STATES_COUNT) * Board::CELLS_COUNT, 0) {
+        Board board;
+        if (m_player == Board::FIRST_PLAYER) {
+            solvePlayerState(board);
+        } else {
+            solveOpponentState(board);
+        }
+    }
+
+    char getPlayer() const {
+        return m_player;
+    }
+
+    // Legal actions of the player in a reachable non-terminal state where it moves, 0 elsewhere.
+    Board::Mask getActions(const Board::State state) const {
+        return m_actions[state];
+    }
+
+    // Optimal return from a state where the player moves.
+    QValue getValue(const Board::State state) const {
+        return m_values[state];
+    }
+
+    QValue getQValue(const Board::State state, const int cell) const {
+        return m_qvalues[std::size_t(state) * Board::CELLS_COUNT + cell];
+    }
+
+    Board::Mask getOptimalActions(const Board::State state) const {
+        Board::Mask optimal = 0;
+        for (Board::Mask actions = m_actions[state]; actions; actions &= actions - 1) {
+            const auto cell = Board::lowestCell(actions);
+            if (getQValue(state, cell) == m_values[state]) {
+                optimal |= Board::Mask(1 << cell);
+            }
+        }
+        return optimal;
+    }
+
+    // Number of states where the player has to choose an action.
+    std::size_t getStatesCount() const {
+        return std::size_t(std::count_if(m_actions.begin(), m_actions.end(), [](const Board::Mask actions) {
+            return actions != 0;
+        }));
+    }
+
+    // Calls visitor(state, cell, qValue) for every action of every decision state.
+    template <typename Visitor>
+    void forEach(Visitor&& visitor) const {
+        for (int state = 0; state < Board::STATES_COUNT; ++state) {
+            for (Board::Mask actions = m_actions[state]; actions; actions &= actions - 1) {
+                const auto cell = Board::lowestCell(actions);
+                visitor(Board::State(state), cell, getQValue(Board::State(state), cell));
+            }
+        }
+    }
+
+    // Regret of the agent's choice in every decision state, against the optimal value.
+    OptimalityGap measureGap(const Agent& agent, Random& random) const {
+        OptimalityGap gap;
+        double totalRegret = 0;
+        for (int state = 0; state < Board::STATES_COUNT; ++state) {
+            if (!m_actions[state]) {
+                continue;
+            }
+            const auto cell = Board::toCell(agent.chooseAction(Board::fromState(Board::State(state)), random));
+            const auto regret = m_values[state] - getQValue(Board::State(state), cell);
+            ++gap.states;
+            gap.suboptimalStates += regret > 0;
+            gap.maxRegret = std::max(gap.maxRegret, regret);
+            totalRegret += regret;
+        }
+        gap.meanRegret = gap.states ? totalRegret / gap.states : 0;
+        return gap;
+    }
+
+private:
+    QValue getReward(const Board& board) const {
+        if (board.checkWin(m_opponent)) {
+            return -1;
+        }
+        return m_rewards == RewardShaping::Aggressive ? board.getAggressiveReward(m_player)
+                                                      : board.getDefensiveReward(m_player);
+    }
+
+    // The player moves; board is not over.
+    QValue solvePlayerState(Board& board) {
+        const auto state = board.getState();
+        if (m_solved[state]) {
+            return m_values[state];
+        }
+
+        const auto actions = board.getEmptyMask();
+        auto best = std::numeric_limits<QValue>::lowest();
+        for (Board::Mask rest = actions; rest; rest &= rest - 1) {
+            const auto cell = Board::lowestCell(rest);
+            board.move(cell, m_player);
+            const auto qValue = board.isOver() ? getReward(board) : m_discount * solveOpponentState(board);
+            board.unmakeMove(cell);
+            m_qvalues[std::size_t(state) * Board::CELLS_COUNT + cell] = qValue;
+            best = std::max(best, qValue);
+        }
+
+        m_solved[state] = true;
+        m_actions[state] = actions;
+        m_values[state] = best;
+        return best;
+    }
+
+    // The opponent moves; board is not over.
+    QValue solveOpponentState(Board& board) {
+        const auto state = board.getState();
+        if (m_solved[state]) {
+            return m_values[state];
+        }
+
+        auto worst = std::numeric_limits<QValue>::max();
+        QValue total = 0;
+        int count = 0;
+        for (Board::Mask rest = board.getEmptyMask(); rest; rest &= rest - 1) {
+            const auto cell = Board::lowestCell(rest);
+            board.move(cell, m_opponent);
+            const auto value = board.isOver() ? getReward(board) : solvePlayerState(board);
+            board.unmakeMove(cell);
+            worst = std::min(worst, value);
+            total += value;
+            ++count;
+        }
+
+        const auto value = m_opponentModel == OpponentModel::Optimal ? worst : total / count;
+        m_solved[state] = true;
+        m_values[state] = value;
+        return value;
+    }
+
+    const char m_player;
+    const char m_opponent;
+    const RewardShaping m_rewards;
+    const OpponentModel m_opponentModel;
+    const double m_discount;
+
+    std::vector<bool> m_solved;
+    std::vector<QValue> m_values;
+    std::vector<Board::Mask> m_actions;
+    std::vector<QValue> m_qvalues;
+};
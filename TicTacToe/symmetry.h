@@ -0,0 +1,169 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+
+#include "game.h"
+
+template <int Size>
+using SymmetryCellPermutations = std::array<std::array<std::int8_t, Size * Size>, 8>;
+
+template <int Size>
+using SymmetryMaskPermutations = std::array<std::array<std::uint16_t, 1 << (Size * Size)>, 8>;
+
+// Image of every cell under each of the 8 transforms, see Symmetry.
+template <int Size>
+constexpr SymmetryCellPermutations<Size> makeCellPermutations() {
+    constexpr int last = Size - 1;
+    SymmetryCellPermutations<Size> permutations{};
+    for (int row = 0; row < Size; ++row) {
+        for (int col = 0; col < Size; ++col) {
+            const int images[8][2] = {
+                {row, col},               // identity
+                {col, last - row},        // rotate 90
+                {last - row, last - col}, // rotate 180
+                {last - col, row},        // rotate 270
+                {row, last - col},        // mirror columns
+                {last - row, col},        // mirror rows
+                {col, row},               // main diagonal
+                {last - col, last - row}, // anti-diagonal
+            };
+            for (int t = 0; t < 8; ++t) {
+                permutations[t][row * Size + col] = std::int8_t(images[t][0] * Size + images[t][1]);
+            }
+        }
+    }
+    return permutations;
+}
+
+// Image of every cell subset under each of the 8 transforms.
+template <int Size>
+constexpr SymmetryMaskPermutations<Size> makeMaskPermutations() {
+    constexpr auto cellPermutations = makeCellPermutations<Size>();
+    SymmetryMaskPermutations<Size> permutations{};
+    for (int t = 0; t < 8; ++t) {
+        for (int mask = 0; mask < (1 << (Size * Size)); ++mask) {
+            for (int cell = 0; cell < Size * Size; ++cell) {
+                if (mask & (1 << cell)) {
+                    permutations[t][mask] |= std::uint16_t(1 << cellPermutations[t][cell]);
+                }
+            }
+        }
+    }
+    return permutations;
+}
+
+// The 8 rotations and reflections of the board. A transform t moves cell
+// to transformCell(cell, t); canonicalize() maps a position to the transformed
+// copy with the smallest Board::State and reports the transform used.
+class Symmetry final {
+public:
+    using Transform = int;
+    // Bit t is set when transform t maps the position onto itself.
+    using TransformSet = std::uint8_t;
+
+    constexpr static const int TRANSFORMS_COUNT = 8;
+    constexpr static const Transform IDENTITY = 0;
+
+    using CellPermutations = SymmetryCellPermutations<Board::BOARD_SIZE>;
+    using MaskPermutations = SymmetryMaskPermutations<Board::BOARD_SIZE>;
+
+    struct Canonical {
+        Board::State state;
+        Transform transform;
+        TransformSet stabilizer;
+    };
+
+    constexpr static const CellPermutations CELL_PERMUTATIONS = makeCellPermutations<Board::BOARD_SIZE>();
+    constexpr static const MaskPermutations MASK_PERMUTATIONS = makeMaskPermutations<Board::BOARD_SIZE>();
+
+    constexpr static Transform inverse(const Transform transform) {
+        // Quarter turns invert each other, every reflection is its own inverse.
+        return transform == 1 ? 3 : transform == 3 ? 1 : transform;
+    }
+
+    static int transformCell(const int cell, const Transform transform) {
+        return CELL_PERMUTATIONS[transform][cell];
+    }
+
+    static QAction transformAction(const QAction& action, const Transform transform) {
+        return Board::toAction(transformCell(Board::toCell(action), transform));
+    }
+
+    static Board::Mask transformMask(const Board::Mask mask, const Transform transform) {
+        return MASK_PERMUTATIONS[transform][mask];
+    }
+
+    static Board transform(const Board& board, const Transform transform) {
+        return Board::fromMasks(transformMask(board.getMask(Board::FIRST_PLAYER), transform),
+                                transformMask(board.getMask(Board::SECOND_PLAYER), transform));
+    }
+
+    static TransformSet getStabilizer(const Board& board) {
+        const auto first = board.getMask(Board::FIRST_PLAYER);
+        const auto second = board.getMask(Board::SECOND_PLAYER);
+        TransformSet stabilizer = 1 << IDENTITY;
+        for (Transform t = 1; t < TRANSFORMS_COUNT; ++t) {
+            if (transformMask(first, t) == first && transformMask(second, t) == second) {
+                stabilizer |= TransformSet(1 << t);
+            }
+        }
+        return stabilizer;
+    }
+
+    static Canonical canonicalize(const Board& board) {
+        Canonical canonical{board.getState(), IDENTITY, 0};
+        for (Transform t = 1; t < TRANSFORMS_COUNT; ++t) {
+            const auto state = transform(board, t).getState();
+            if (state < canonical.state) {
+                canonical.state = state;
+                canonical.transform = t;
+            }
+        }
+        canonical.stabilizer = getStabilizer(Board::fromState(canonical.state));
+        return canonical;
+    }
+
+    // Table lookup over all Board::STATES_COUNT indices, built on first use.
+    static const Canonical& canonicalize(const Board::State state) {
+        static const std::vector<Canonical> table = [] {
+            std::vector<Canonical> canonicals(Board::STATES_COUNT);
+            for (int state = 0; state < Board::STATES_COUNT; ++state) {
+                canonicals[state] = canonicalize(Board::fromState(Board::State(state)));
+            }
+            return canonicals;
+        }();
+        return table[state];
+    }
+
+    // The smallest cell among those the stabilizer maps the given cell to.
+    static int canonicalCell(const int cell, const TransformSet stabilizer) {
+        int result = cell;
+        for (Transform t = 1; t < TRANSFORMS_COUNT; ++t) {
+            if (stabilizer & (1 << t)) {
+                result = std::min(result, transformCell(cell, t));
+            }
+        }
+        return result;
+    }
+
+    // Empty cells with pairwise different outcomes: of every group of moves
+    // that lead to symmetric positions only the smallest cell is kept.
+    static Board::Mask getDistinctMoves(const Board& board) {
+        const auto empty = board.getEmptyMask();
+        const auto stabilizer = getStabilizer(board);
+        if (stabilizer == (1 << IDENTITY)) {
+            return empty;
+        }
+        Board::Mask distinct = 0;
+        for (Board::Mask rest = empty; rest; rest &= rest - 1) {
+            const auto cell = Board::lowestCell(rest);
+            if (canonicalCell(cell, stabilizer) == cell) {
+                distinct |= Board::Mask(1 << cell);
+            }
+        }
+        return distinct;
+    }
+};
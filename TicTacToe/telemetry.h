@@ -0,0 +1,322 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+
+// Counts of small non-negative integers, one bucket per value and a last
+// bucket for everything larger. Updates are relaxed atomic increments.
+template <int BucketsCount>
+class LinearHistogram final {
+public:
+    using Buckets = std::array<std::uint64_t, BucketsCount>;
+
+    LinearHistogram() {
+        for (auto& bucket : m_buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    static int bucketOf(const std::uint64_t value) {
+        return value < BucketsCount - 1 ? int(value) : BucketsCount - 1;
+    }
+
+    void add(const Buckets& counts) {
+        for (int i = 0; i < BucketsCount; ++i) {
+            if (counts[i]) {
+                m_buckets[i].fetch_add(counts[i], std::memory_order_relaxed);
+            }
+        }
+    }
+
+    Buckets snapshot() const {
+        Buckets counts{};
+        for (int i = 0; i < BucketsCount; ++i) {
+            counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        }
+        return counts;
+    }
+
+    // Smallest value not exceeded by the given fraction of the counts.
+    static int percentile(const Buckets& counts, const double fraction) {
+        std::uint64_t total = 0;
+        for (const auto count : counts) {
+            total += count;
+        }
+        std::uint64_t seen = 0;
+        for (int i = 0; i < BucketsCount; ++i) {
+            seen += counts[i];
+            if (total && seen >= fraction * total) {
+                return i;
+            }
+        }
+        return 0;
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, BucketsCount> m_buckets;
+};
+
+enum class EpisodeOutcome {
+    Win,
+    Draw,
+    Loss
+};
+
+enum class TrainingPhase {
+    Agent,
+    Board
+};
+
+using StepsHistogram = LinearHistogram<64>;
+
+// Statistics a trainer thread accumulates locally and publishes in bulk with
+// TrainingTelemetry::flush(), so the hot loop touches no shared cache lines.
+struct EpisodeStats {
+    std::uint64_t episodes = 0;
+    std::uint64_t steps = 0;
+    std::uint64_t wins = 0;
+    std::uint64_t draws = 0;
+    std::uint64_t losses = 0;
+    std::uint64_t updates = 0;
+    double absoluteUpdates = 0;
+    std::uint64_t timedEpisodes = 0;
+    std::array<std::uint64_t, 2> phaseNanos{};
+    StepsHistogram::Buckets stepsHistogram{};
+
+    void addUpdate(const double update) {
+        ++updates;
+        absoluteUpdates += update < 0 ? -update : update;
+    }
+
+    void addEpisode(const int episodeSteps, const EpisodeOutcome outcome) {
+        ++episodes;
+        steps += episodeSteps;
+        ++stepsHistogram[StepsHistogram::bucketOf(episodeSteps)];
+        switch (outcome) {
+        case EpisodeOutcome::Win: ++wins; break;
+        case EpisodeOutcome::Draw: ++draws; break;
+        case EpisodeOutcome::Loss: ++losses; break;
+        }
+    }
+};
+
+// Splits the time of an episode between agent and board code. Reading the
+// clock at every switch is too expensive for every episode, so trainers only
+// enable it on a sample of them (TrainingTelemetry::isTimedEpisode()).
+class PhaseClock final {
+public:
+    PhaseClock(EpisodeStats& stats, const bool enabled) : m_stats(stats), m_enabled(enabled) {
+        if (m_enabled) {
+            ++m_stats.timedEpisodes;
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~PhaseClock() {
+        enter(m_phase);
+    }
+
+    void enter(const TrainingPhase phase) {
+        if (m_enabled) {
+            const auto now = std::chrono::steady_clock::now();
+            m_stats.phaseNanos[int(m_phase)] +=
+                std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_start).count());
+            m_start = now;
+        }
+        m_phase = phase;
+    }
+
+private:
+    EpisodeStats& m_stats;
+    const bool m_enabled;
+    TrainingPhase m_phase = TrainingPhase::Board;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+enum class TelemetryFormat {
+    JsonLines,
+    Csv
+};
+
+// Shared sink of trainer statistics. Counters are relaxed atomics fed by
+// flush(); whichever flush first finds the interval elapsed writes one sample
+// with totals and the rates over the interval since the previous sample.
+// Percentiles of episode steps are over that interval too. qtable_size is the
+// number of states with a learned value (see qtable.h), or the number of
+// parameters for network models.
+class TrainingTelemetry final {
+public:
+    // One episode in TIMING_PERIOD has its phases timed.
+    constexpr static const std::uint64_t TIMING_PERIOD = 64;
+
+    TrainingTelemetry(std::ostream& output, const TelemetryFormat format, const std::chrono::milliseconds interval)
+        : m_output(output)
+        , m_format(format)
+        , m_interval(interval)
+        , m_start(std::chrono::steady_clock::now()) {
+        m_nextSample.store(m_interval.count(), std::memory_order_relaxed);
+        if (m_format == TelemetryFormat::Csv) {
+            m_output << "time_s,episodes,episodes_per_s,steps_per_episode,steps_p50,steps_p90,qtable_size,"
+                        "qtable_growth,mean_abs_update,win_rate,draw_rate,loss_rate,agent_time_share,board_time_share\n";
+        }
+    }
+
+    static bool isTimedEpisode(const std::uint64_t episode) {
+        return episode % TIMING_PERIOD == 0;
+    }
+
+    void flush(EpisodeStats& stats, const std::size_t qtableSize) {
+        m_counters[EPISODES].fetch_add(stats.episodes, std::memory_order_relaxed);
+        m_counters[STEPS].fetch_add(stats.steps, std::memory_order_relaxed);
+        m_counters[WINS].fetch_add(stats.wins, std::memory_order_relaxed);
+        m_counters[DRAWS].fetch_add(stats.draws, std::memory_order_relaxed);
+        m_counters[LOSSES].fetch_add(stats.losses, std::memory_order_relaxed);
+        m_counters[UPDATES].fetch_add(stats.updates, std::memory_order_relaxed);
+        m_counters[ABSOLUTE_UPDATES_NANO].fetch_add(std::uint64_t(stats.absoluteUpdates * 1e9), std::memory_order_relaxed);
+        m_counters[AGENT_NANOS].fetch_add(stats.phaseNanos[int(TrainingPhase::Agent)], std::memory_order_relaxed);
+        m_counters[BOARD_NANOS].fetch_add(stats.phaseNanos[int(TrainingPhase::Board)], std::memory_order_relaxed);
+        m_stepsHistogram.add(stats.stepsHistogram);
+        stats = EpisodeStats{};
+
+        const auto elapsed = getElapsedMillis();
+        auto nextSample = m_nextSample.load(std::memory_order_relaxed);
+        if (elapsed >= nextSample
+            && m_nextSample.compare_exchange_strong(nextSample, elapsed + m_interval.count(), std::memory_order_relaxed)) {
+            sample(qtableSize);
+        }
+    }
+
+    // Writes the last sample; call once the trainers are done.
+    void finish(const std::size_t qtableSize) {
+        sample(qtableSize);
+        m_output.flush();
+    }
+
+private:
+    enum Counter {
+        EPISODES,
+        STEPS,
+        WINS,
+        DRAWS,
+        LOSSES,
+        UPDATES,
+        ABSOLUTE_UPDATES_NANO,
+        AGENT_NANOS,
+        BOARD_NANOS,
+        COUNTERS_COUNT
+    };
+
+    using Counters = std::array<std::uint64_t, COUNTERS_COUNT>;
+
+    // Significant digits of the values that are not counts.
+    constexpr static const int RATE_PRECISION = 9;
+
+    struct Value {
+        double value;
+        bool isCount;
+    };
+
+    std::int64_t getElapsedMillis() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+    void sample(const std::size_t qtableSize) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Counters counters;
+        for (int i = 0; i < COUNTERS_COUNT; ++i) {
+            counters[i] = m_counters[i].load(std::memory_order_relaxed);
+        }
+        Counters delta;
+        for (int i = 0; i < COUNTERS_COUNT; ++i) {
+            delta[i] = counters[i] - m_lastCounters[i];
+        }
+        const auto seconds = getElapsedMillis() / 1000.0;
+        const auto intervalSeconds = seconds - m_lastSeconds;
+        // Differences of snapshots, as trainers keep adding to the shared histogram.
+        const auto totalHistogram = m_stepsHistogram.snapshot();
+        StepsHistogram::Buckets histogram;
+        for (std::size_t i = 0; i < histogram.size(); ++i) {
+            histogram[i] = totalHistogram[i] - m_lastHistogram[i];
+        }
+
+        const auto ratio = [](const double part, const double total) {
+            return total > 0 ? part / total : 0.0;
+        };
+        const auto episodes = double(delta[EPISODES]);
+        const auto phaseNanos = double(delta[AGENT_NANOS] + delta[BOARD_NANOS]);
+        // Counts are written as integers, whatever their size; rates with RATE_PRECISION digits.
+        const Value values[] = {
+            {seconds, false},
+            {double(counters[EPISODES]), true},
+            {ratio(episodes, intervalSeconds), false},
+            {ratio(double(delta[STEPS]), episodes), false},
+            {double(StepsHistogram::percentile(histogram, 0.5)), true},
+            {double(StepsHistogram::percentile(histogram, 0.9)), true},
+            {double(qtableSize), true},
+            {double(qtableSize) - double(m_lastQTableSize), true},
+            {ratio(delta[ABSOLUTE_UPDATES_NANO] / 1e9, double(delta[UPDATES])), false},
+            {ratio(double(delta[WINS]), episodes), false},
+            {ratio(double(delta[DRAWS]), episodes), false},
+            {ratio(double(delta[LOSSES]), episodes), false},
+            {ratio(double(delta[AGENT_NANOS]), phaseNanos), false},
+            {ratio(double(delta[BOARD_NANOS]), phaseNanos), false},
+        };
+        const auto write = [&](const Value& value) {
+            if (value.isCount) {
+                m_output << std::int64_t(value.value);
+            } else {
+                m_output << value.value;
+            }
+        };
+
+        const auto precision = m_output.precision(RATE_PRECISION);
+        if (m_format == TelemetryFormat::Csv) {
+            for (std::size_t i = 0; i < std::size(values); ++i) {
+                m_output << (i ? "," : "");
+                write(values[i]);
+            }
+            m_output << '\n';
+        } else {
+            static const char* const NAMES[] = {
+                "time_s", "episodes", "episodes_per_s", "steps_per_episode", "steps_p50", "steps_p90",
+                "qtable_size", "qtable_growth", "mean_abs_update", "win_rate", "draw_rate", "loss_rate",
+                "agent_time_share", "board_time_share",
+            };
+            static_assert(std::size(NAMES) == std::size(values), "every telemetry value needs a name");
+            m_output << '{';
+            for (std::size_t i = 0; i < std::size(values); ++i) {
+                m_output << (i ? ", " : "") << '"' << NAMES[i] << "\": ";
+                write(values[i]);
+            }
+            m_output << "}\n";
+        }
+        m_output.precision(precision);
+
+        m_lastCounters = counters;
+        m_lastHistogram = totalHistogram;
+        m_lastSeconds = seconds;
+        m_lastQTableSize = qtableSize;
+    }
+
+    std::ostream& m_output;
+    const TelemetryFormat m_format;
+    const std::chrono::milliseconds m_interval;
+    const std::chrono::steady_clock::time_point m_start;
+
+    std::array<std::atomic<std::uint64_t>, COUNTERS_COUNT> m_counters{};
+    StepsHistogram m_stepsHistogram;
+    std::atomic<std::int64_t> m_nextSample{0};
+
+    std::mutex m_mutex;
+    Counters m_lastCounters{};
+    StepsHistogram::Buckets m_lastHistogram{};
+    double m_lastSeconds = 0;
+    std::size_t m_lastQTableSize = 0;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+
+// Fixed set of worker threads with one task deque each. A thread runs the
+// newest task of its own deque first and steals the oldest task of another
+// deque when its own is empty. Threads waiting in parallelFor() run queued
+// tasks meanwhile, so parallel loops may nest inside each other.
+class ThreadPool final {
+public:
+    explicit ThreadPool(const unsigned threadsCount = std::max(1U, std::thread::hardware_concurrency()))
+        : m_queues(std::max(1U, threadsCount)) {
+        // The thread calling parallelFor() takes part in the work, so one worker less is enough.
+        for (unsigned i = 1; i < threadsCount; ++i) {
+            m_workers.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_condition.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const {
+        return unsigned(m_workers.size()) + 1;
+    }
+
+    // Calls function(index) for every index in [0, count) and returns when all calls finished.
+    // Indices are handed out in increasing order.
+    template <typename Function>
+    void parallelFor(const std::size_t count, Function&& function) {
+        std::atomic<std::size_t> nextIndex{0};
+        const auto run = [&] {
+            for (auto index = nextIndex.fetch_add(1); index < count; index = nextIndex.fetch_add(1)) {
+                function(index);
+            }
+        };
+
+        const auto queue = getQueueIndex();
+        const auto helpersCount = std::min<std::size_t>(m_workers.size(), count);
+        std::atomic<std::size_t> pendingHelpers{helpersCount};
+        for (std::size_t i = 0; i < helpersCount; ++i) {
+            push(queue, [&] {
+                run();
+                pendingHelpers.fetch_sub(1, std::memory_order_release);
+            });
+        }
+        if (helpersCount) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+            }
+            m_condition.notify_all();
+        }
+
+        run();
+
+        // Helpers not started yet are found in our own deque; others may be stuck behind
+        // tasks the running helpers wait for, so keep running tasks until all are done.
+        while (pendingHelpers.load(std::memory_order_acquire) != 0) {
+            if (!tryRunTask(queue)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    using Task = std::function<void()>;
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // Workers use their own deque, every other thread the first one.
+    std::size_t getQueueIndex() const {
+        return t_pool == this ? t_queue : 0;
+    }
+
+    void push(const std::size_t queue, Task task) {
+        std::lock_guard<std::mutex> lock(m_queues[queue].mutex);
+        m_queues[queue].tasks.push_back(std::move(task));
+        m_queuedCount.fetch_add(1, std::memory_order_release);
+    }
+
+    bool tryRunTask(const std::size_t queue) {
+        Task task;
+        for (std::size_t i = 0; i < m_queues.size() && !task; ++i) {
+            auto& victim = m_queues[(queue + i) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                if (i == 0) {
+                    task = std::move(victim.tasks.back());
+                    victim.tasks.pop_back();
+                } else {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                }
+                m_queuedCount.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        if (!task) {
+            return false;
+        }
+        task();
+        return true;
+    }
+
+    void work(const std::size_t queue) {
+        t_pool = this;
+        t_queue = queue;
+        while (true) {
+            if (tryRunTask(queue)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] {
+                return m_stopped || m_queuedCount.load(std::memory_order_acquire) != 0;
+            });
+            if (m_stopped && m_queuedCount.load(std::memory_order_acquire) == 0) {
+                return;
+            }
+        }
+    }
+
+    inline static thread_local const ThreadPool* t_pool = nullptr;
+    inline static thread_local std::size_t t_queue = 0;
+
+    std::vector<Queue> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<std::size_t> m_queuedCount{0};
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopped = false;
+};
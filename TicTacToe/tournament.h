@@ -0,0 +1,339 @@
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <memory>
+#include <functional>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "game.h"
+#include "agent.h"
+#include "random.h"
+#include "thread_pool.h"
+#include "evaluation.h"
+
+// Counts of durations in logarithmic buckets, SUBBUCKETS per power of two of
+// nanoseconds, so percentiles are known within 1 / SUBBUCKETS of their value
+// at a fixed size whatever the number of samples.
+class LatencyHistogram final {
+public:
+    constexpr static const int SUBBUCKETS = 8;
+    constexpr static const int OCTAVES = 40;
+    constexpr static const int BUCKETS_COUNT = SUBBUCKETS * OCTAVES;
+
+    void add(const std::uint64_t nanoseconds) {
+        ++m_buckets[bucketOf(nanoseconds)];
+        ++m_count;
+        m_max = std::max(m_max, nanoseconds);
+    }
+
+    LatencyHistogram& operator+=(const LatencyHistogram& other) {
+        for (int i = 0; i < BUCKETS_COUNT; ++i) {
+            m_buckets[i] += other.m_buckets[i];
+        }
+        m_count += other.m_count;
+        m_max = std::max(m_max, other.m_max);
+        return *this;
+    }
+
+    std::uint64_t count() const {
+        return m_count;
+    }
+
+    std::uint64_t max() const {
+        return m_max;
+    }
+
+    // Upper bound of the bucket holding the given fraction of the samples, 0 without samples.
+    std::uint64_t percentile(const double fraction) const {
+        std::uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS_COUNT; ++i) {
+            seen += m_buckets[i];
+            if (m_count && seen >= fraction * m_count) {
+                return std::min(upperBound(i), m_max);
+            }
+        }
+        return 0;
+    }
+
+private:
+    // Values below SUBBUCKETS get a bucket each; above, the bucket is given by the
+    // highest bit and the SUBBUCKETS_BITS bits below it.
+    constexpr static const int SUBBUCKETS_BITS = 3;
+    static_assert(1 << SUBBUCKETS_BITS == SUBBUCKETS, "a power of two of subbuckets");
+
+    static int bucketOf(const std::uint64_t value) {
+        if (value < SUBBUCKETS) {
+            return int(value);
+        }
+        int highest = 63;
+        while (!(value >> highest)) {
+            --highest;
+        }
+        const auto subbucket = int(value >> (highest - SUBBUCKETS_BITS)) - SUBBUCKETS;
+        return std::min(BUCKETS_COUNT - 1, (highest - SUBBUCKETS_BITS + 1) * SUBBUCKETS + subbucket);
+    }
+
+    static std::uint64_t upperBound(const int bucket) {
+        if (bucket < SUBBUCKETS) {
+            return std::uint64_t(bucket);
+        }
+        const auto shift = bucket / SUBBUCKETS - 1;
+        const auto subbucket = std::uint64_t(bucket % SUBBUCKETS + SUBBUCKETS);
+        return ((subbucket + 1) << shift) - 1;
+    }
+
+    std::array<std::uint64_t, BUCKETS_COUNT> m_buckets{};
+    std::uint64_t m_count = 0;
+    std::uint64_t m_max = 0;
+};
+
+// A participant of a tournament. Agents such as MinMax are built for one seat,
+// so each entry gives the agent playing first and the one playing second,
+// possibly the same. Agents are called from several threads at once. Agents
+// that serialize their moves, such as MCTS, are given by makeAgent(player)
+// instead: every shard builds its own, so games run in parallel and move
+// latencies don't include waits for other games.
+struct TournamentEntry {
+    std::string name;
+    const Agent* asFirst;
+    const Agent* asSecond;
+    std::function<std::unique_ptr<Agent>(char)> makeAgent = nullptr;
+};
+
+struct TournamentOptions {
+    // Games of every ordered pairing, so two entries meet twice as often.
+    int gamesPerSeat = 200;
+    std::uint64_t seed = Random::DEFAULT_SEED;
+};
+
+struct TournamentResult {
+    std::vector<std::string> names;
+    // Row-major, scores of row entry against the column entry in both seats.
+    std::vector<EvaluationResult> matrix;
+    std::vector<LatencyHistogram> latencies;
+    // Bradley-Terry strengths on the Elo scale, 0 on average.
+    std::vector<double> ratings;
+    double seconds = 0;
+
+    const EvaluationResult& at(const std::size_t row, const std::size_t column) const {
+        return matrix[row * names.size() + column];
+    }
+};
+
+// Bradley-Terry ratings of the matrix on the Elo scale, fitted by the MM algorithm,
+// a draw counting as half a win for each side. Every pairing gets one virtual draw
+// so ratings stay finite for entries that never lose or never win.
+inline std::vector<double> computeRatings(const std::vector<EvaluationResult>& matrix, const std::size_t count) {
+    constexpr int ITERATIONS = 1000;
+    constexpr double PRIOR_GAMES = 1;
+
+    std::vector<double> scores(count, 0);
+    std::vector<double> games(count * count, 0);
+    for (std::size_t i = 0; i < count; ++i) {
+        for (std::size_t j = 0; j < count; ++j) {
+            const auto& result = matrix[i * count + j];
+            if (i == j || result.games == 0) {
+                continue;
+            }
+            scores[i] += result.wins + 0.5 * result.draws + 0.5 * PRIOR_GAMES;
+            games[i * count + j] = result.games + PRIOR_GAMES;
+        }
+    }
+
+    std::vector<double> strengths(count, 1);
+    std::vector<double> next(count);
+    for (int iteration = 0; iteration < ITERATIONS; ++iteration) {
+        for (std::size_t i = 0; i < count; ++i) {
+            double denominator = 0;
+            for (std::size_t j = 0; j < count; ++j) {
+                if (games[i * count + j] > 0) {
+                    denominator += games[i * count + j] / (strengths[i] + strengths[j]);
+                }
+            }
+            next[i] = denominator > 0 ? scores[i] / denominator : strengths[i];
+        }
+        // Strengths are known up to a factor: keep their geometric mean at 1.
+        double logSum = 0;
+        for (const auto strength : next) {
+            logSum += std::log(strength);
+        }
+        const auto scale = std::exp(-logSum / double(count));
+        for (std::size_t i = 0; i < count; ++i) {
+            strengths[i] = next[i] * scale;
+        }
+    }
+
+    std::vector<double> ratings(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        ratings[i] = 400 * std::log10(strengths[i]);
+    }
+    return ratings;
+}
+
+// Plays one game from the empty board, timing every move into the latency of
+// the player making it, and scores it for the first player.
+inline EvaluationResult playTournamentGame(const Agent& first, const Agent& second, Random& random,
+                                           LatencyHistogram& firstLatency, LatencyHistogram& secondLatency) {
+    Board game;
+    char currentPlayer = Board::FIRST_PLAYER;
+    while (!game.isOver()) {
+        const auto isFirst = currentPlayer == Board::FIRST_PLAYER;
+        const auto start = std::chrono::steady_clock::now();
+        const auto action = isFirst ? first.chooseAction(game, random) : second.chooseAction(game, random);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        (isFirst ? firstLatency : secondLatency)
+            .add(std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        game.move(action, currentPlayer);
+        currentPlayer = getOponent(currentPlayer);
+    }
+
+    EvaluationResult result;
+    result.games = 1;
+    if (game.checkWin(Board::FIRST_PLAYER)) {
+        result.wins = 1;
+    } else if (game.checkWin(Board::SECOND_PLAYER)) {
+        result.losses = 1;
+    } else {
+        result.draws = 1;
+    }
+    return result;
+}
+
+// Round robin of all entries: every ordered pairing plays gamesPerSeat games.
+// Games are split into shards run on the pool, each replayed with its own random
+// stream of seed numbered by the shard, so the results depend on the seed only
+// and not on how many threads the pool has.
+inline TournamentResult playTournament(const std::vector<TournamentEntry>& entries, const TournamentOptions& options,
+                                       ThreadPool& pool) {
+    constexpr int SHARD_SIZE = 32;
+
+    struct Shard {
+        std::size_t first;
+        std::size_t second;
+        int games;
+        EvaluationResult result;
+        LatencyHistogram firstLatency;
+        LatencyHistogram secondLatency;
+    };
+
+    const auto count = entries.size();
+    std::vector<Shard> shards;
+    for (std::size_t first = 0; first < count; ++first) {
+        for (std::size_t second = 0; second < count; ++second) {
+            if (first == second) {
+                continue;
+            }
+            for (int games = 0; games < options.gamesPerSeat; games += SHARD_SIZE) {
+                shards.push_back(Shard{first, second, std::min(SHARD_SIZE, options.gamesPerSeat - games), {}, {}, {}});
+            }
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    pool.parallelFor(shards.size(), [&](const std::size_t index) {
+        auto& shard = shards[index];
+        Random random(options.seed, index);
+        const auto& firstEntry = entries[shard.first];
+        const auto& secondEntry = entries[shard.second];
+        const auto ownFirst = firstEntry.makeAgent ? firstEntry.makeAgent(Board::FIRST_PLAYER) : nullptr;
+        const auto ownSecond = secondEntry.makeAgent ? secondEntry.makeAgent(Board::SECOND_PLAYER) : nullptr;
+        const auto& first = ownFirst ? *ownFirst : *firstEntry.asFirst;
+        const auto& second = ownSecond ? *ownSecond : *secondEntry.asSecond;
+        for (int i = 0; i < shard.games; ++i) {
+            shard.result += playTournamentGame(first, second, random, shard.firstLatency, shard.secondLatency);
+        }
+    });
+
+    TournamentResult result;
+    result.matrix.resize(count * count);
+    result.latencies.resize(count);
+    for (const auto& shard : shards) {
+        auto& firstScore = result.matrix[shard.first * count + shard.second];
+        auto& secondScore = result.matrix[shard.second * count + shard.first];
+        firstScore += shard.result;
+        secondScore.games += shard.result.games;
+        secondScore.wins += shard.result.losses;
+        secondScore.draws += shard.result.draws;
+        secondScore.losses += shard.result.wins;
+        result.latencies[shard.first] += shard.firstLatency;
+        result.latencies[shard.second] += shard.secondLatency;
+    }
+    for (const auto& entry : entries) {
+        result.names.push_back(entry.name);
+    }
+    result.ratings = computeRatings(result.matrix, count);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Scores of the matrix as points per game, columns numbered as the rows,
+// then the entries from the highest rating down.
+inline std::ostream& operator<<(std::ostream& ss, const TournamentResult& result) {
+    constexpr int COLUMN_WIDTH = 8;
+    const auto count = result.names.size();
+    std::size_t nameWidth = 0;
+    for (const auto& name : result.names) {
+        nameWidth = std::max(nameWidth, name.size());
+    }
+    const auto width = int(nameWidth) + 5;
+
+    const auto flags = ss.flags();
+    const auto precision = ss.precision();
+    ss << std::fixed << std::setprecision(3);
+
+    ss << std::setw(width) << "";
+    for (std::size_t column = 0; column < count; ++column) {
+        ss << std::setw(COLUMN_WIDTH) << column + 1;
+    }
+    ss << std::endl;
+    for (std::size_t row = 0; row < count; ++row) {
+        ss << std::setw(3) << row + 1 << "  " << std::left << std::setw(int(nameWidth)) << result.names[row]
+           << std::right;
+        for (std::size_t column = 0; column < count; ++column) {
+            const auto& score = result.at(row, column);
+            if (row == column || score.games == 0) {
+                ss << std::setw(COLUMN_WIDTH) << "-";
+            } else {
+                ss << std::setw(COLUMN_WIDTH) << (score.wins + 0.5 * score.draws) / score.games;
+            }
+        }
+        ss << std::endl;
+    }
+
+    std::vector<std::size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](const std::size_t a, const std::size_t b) {
+        return result.ratings[a] > result.ratings[b];
+    });
+    ss << std::setprecision(0) << std::endl << std::setw(width) << "" << std::setw(COLUMN_WIDTH) << "Elo"
+       << std::setw(COLUMN_WIDTH) << "Games" << "  Move latency p50/p90/p99/max (ns)" << std::endl;
+    for (const auto index : order) {
+        int games = 0;
+        for (std::size_t column = 0; column < count; ++column) {
+            games += column == index ? 0 : result.at(index, column).games;
+        }
+        const auto& latency = result.latencies[index];
+        ss << std::setw(3) << index + 1 << "  " << std::left << std::setw(int(nameWidth)) << result.names[index]
+           << std::right << std::setw(COLUMN_WIDTH) << result.ratings[index] << std::setw(COLUMN_WIDTH) << games
+           << "  " << latency.percentile(0.5) << "/" << latency.percentile(0.9) << "/" << latency.percentile(0.99)
+           << "/" << latency.max() << std::endl;
+    }
+
+    int games = 0;
+    for (const auto& score : result.matrix) {
+        games += score.games;
+    }
+    ss << std::setprecision(3) << "Games: " << games / 2 << " in " << result.seconds << " s" << std::endl;
+    ss.flags(flags);
+    ss.precision(precision);
+    return ss;
+}
@@ -0,0 +1,455 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+#include "game.h"
+#include "agent.h"
+#include "qvalues_agent.h"
+#include "random.h"
+#include "telemetry.h"
+#include "replay.h"
+#include "update_rules.h"
+#include "network_agent.h"
+#include "trajectory_log.h"
+
+const double LEARNING_RATE = 0.01;
+const double DISCOUNT_FACTOR = 0.8;
+
+// Episodes add their statistics to stats; timed episodes also split their
+// time between agent and board code. The opponent is called through its
+// static type, see agent.h. Every transition of the player is passed to
+// learn(state, nextState, action, reward), nextState being Board::NO_STATE
+// for terminal ones.
+template <typename QTable, typename Opponent, typename Learn>
+void playEpisodeOfFirstPlayer(BasicQValuesAgent<QTable>& firstPlayer, const Opponent& secondPlayer,
+                              const double expRate, Random& random, EpisodeStats& stats, const bool timed, Learn&& learn)
+{
+    PhaseClock clock(stats, timed);
+    Board game;
+    auto nextState = game.getState();
+    int steps = 0;
+    auto outcome = EpisodeOutcome::Draw;
+
+    while (true) {
+        const auto stateBeforeAction = nextState;
+        clock.enter(TrainingPhase::Agent);
+        const auto action = firstPlayer.chooseAction(game, expRate, random);
+
+        clock.enter(TrainingPhase::Board);
+        game.move(action, Board::FIRST_PLAYER);
+        ++steps;
+        nextState = game.getState();
+
+        if(game.isOver()) {
+            const auto reward = game.getAggressiveReward(Board::FIRST_PLAYER);
+            outcome = game.checkWin(Board::FIRST_PLAYER) ? EpisodeOutcome::Win : EpisodeOutcome::Draw;
+            clock.enter(TrainingPhase::Agent);
+            learn(stateBeforeAction, Board::NO_STATE, action, reward);
+            break;
+        }
+
+        clock.enter(TrainingPhase::Agent);
+        const auto opponentAction = secondPlayer.chooseAction(game, random);
+        clock.enter(TrainingPhase::Board);
+        game.move(opponentAction, Board::SECOND_PLAYER);
+        ++steps;
+        nextState = game.getState();
+        const auto isOver = game.isOver();
+
+        clock.enter(TrainingPhase::Agent);
+        if(!isOver) {
+            learn(stateBeforeAction, nextState, action, 0.0);
+        } else {
+            outcome = EpisodeOutcome::Loss;
+            learn(stateBeforeAction, Board::NO_STATE, action, -1.0);
+            break;
+        }
+    }
+
+    stats.addEpisode(steps, outcome);
+}
+
+template <typename QTable, typename Opponent, typename Learn>
+void playEpisodeOfSecondPlayer(BasicQValuesAgent<QTable>& secondPlayer, const Opponent& firstPlayer,
+                               const double expRate, Random& random, EpisodeStats& stats, const bool timed, Learn&& learn)
+{
+    PhaseClock clock(stats, timed);
+    Board game;
+    auto nextState = game.getState();
+    auto stateBeforeAction = nextState;
+    int steps = 0;
+    auto outcome = EpisodeOutcome::Draw;
+
+    QAction action;
+
+    while (true) {
+        clock.enter(TrainingPhase::Agent);
+        const auto opponentAction = firstPlayer.chooseAction(game, random);
+        clock.enter(TrainingPhase::Board);
+        game.move(opponentAction, Board::FIRST_PLAYER);
+        ++steps;
+        nextState = game.getState();
+
+        if(game.checkWin(Board::FIRST_PLAYER)) {
+            outcome = EpisodeOutcome::Loss;
+            clock.enter(TrainingPhase::Agent);
+            learn(stateBeforeAction, Board::NO_STATE, action, -1.0);
+            break;
+        } else if(game.checkDraw()) {
+            const auto reward = game.getDefensiveReward(Board::SECOND_PLAYER);
+            clock.enter(TrainingPhase::Agent);
+            learn(stateBeforeAction, Board::NO_STATE, action, reward);
+            break;
+        } else if (steps > 1) {
+            // The opponent's first move follows no action of the player.
+            clock.enter(TrainingPhase::Agent);
+            learn(stateBeforeAction, nextState, action, 0.0);
+        }
+
+        stateBeforeAction = nextState;
+        action = secondPlayer.chooseAction(game, expRate, random);
+        clock.enter(TrainingPhase::Board);
+        game.move(action, Board::SECOND_PLAYER);
+        ++steps;
+        nextState = game.getState();
+
+        if(game.isOver()) {
+            const auto reward = game.getDefensiveReward(Board::SECOND_PLAYER);
+            outcome = game.checkWin(Board::SECOND_PLAYER) ? EpisodeOutcome::Win : EpisodeOutcome::Draw;
+            clock.enter(TrainingPhase::Agent);
+            learn(stateBeforeAction, Board::NO_STATE, action, reward);
+            break;
+        }
+    }
+
+    stats.addEpisode(steps, outcome);
+}
+
+// Episodes updating the Q-values at every transition.
+template <typename QTable, typename Opponent>
+void playLearningEpisodeOfFirstPlayer(BasicQValuesAgent<QTable>& firstPlayer, const Opponent& secondPlayer,
+                                      const double expRate, Random& random, EpisodeStats& stats, const bool timed = false)
+{
+    playEpisodeOfFirstPlayer(firstPlayer, secondPlayer, expRate, random, stats, timed,
+                             [&](const Board::State state, const Board::State nextState, const QAction& action,
+                                 const double reward) {
+                                 stats.addUpdate(firstPlayer.updateQValues(state, nextState, action, reward,
+                                                                           LEARNING_RATE, DISCOUNT_FACTOR));
+                             });
+}
+
+template <typename QTable, typename Opponent>
+void playLearningEpisodeOfSecondPlayer(BasicQValuesAgent<QTable>& secondPlayer, const Opponent& firstPlayer,
+                                       const double expRate, Random& random, EpisodeStats& stats, const bool timed = false)
+{
+    playEpisodeOfSecondPlayer(secondPlayer, firstPlayer, expRate, random, stats, timed,
+                              [&](const Board::State state, const Board::State nextState, const QAction& action,
+                                  const double reward) {
+                                  stats.addUpdate(secondPlayer.updateQValues(state, nextState, action, reward,
+                                                                             LEARNING_RATE, DISCOUNT_FACTOR));
+                              });
+}
+
+// Episodes between two publications of a trainer's statistics to the telemetry.
+constexpr int TELEMETRY_FLUSH_PERIOD = 64;
+
+template <typename Opponent>
+void ticTacToeLearningOfFirstPlayer(QValuesAgent& firstPlayer, const Opponent& secondPlayer, const int episodes, Random& random,
+                                    TrainingTelemetry* telemetry = nullptr)
+{
+    EpisodeStats stats;
+    for (int i = 0; i < episodes; ++i) {
+        const auto expRate = double(episodes - i) / episodes;
+        playLearningEpisodeOfFirstPlayer(firstPlayer, secondPlayer, expRate, random, stats,
+                                         telemetry && TrainingTelemetry::isTimedEpisode(i));
+        if (telemetry && ((i + 1) % TELEMETRY_FLUSH_PERIOD == 0 || i + 1 == episodes)) {
+            telemetry->flush(stats, firstPlayer.getTable().size());
+        }
+    }
+}
+
+template <typename Opponent>
+void ticTacToeLearningOfSecondPlayer(QValuesAgent& secondPlayer, const Opponent& firstPlayer, const int episodes, Random& random,
+                                     TrainingTelemetry* telemetry = nullptr)
+{
+    EpisodeStats stats;
+    for (int i = 0; i < episodes; ++i) {
+        const auto expRate = double(episodes - i) / episodes;
+        playLearningEpisodeOfSecondPlayer(secondPlayer, firstPlayer, expRate, random, stats,
+                                          telemetry && TrainingTelemetry::isTimedEpisode(i));
+        if (telemetry && ((i + 1) % TELEMETRY_FLUSH_PERIOD == 0 || i + 1 == episodes)) {
+            telemetry->flush(stats, secondPlayer.getTable().size());
+        }
+    }
+}
+
+// Runs the episodes of either learning loop on threadsCount workers sharing the
+// learner's Q-table. Workers claim episodes in chunks from a shared counter, so
+// the exploration rate still decays with the global episode number, and each
+// worker draws from its own random stream of seed. Workers publish their
+// statistics to telemetry, if given, once per chunk. Transitions update the
+// Q-values by the given rule.
+template <typename QTable, typename Opponent>
+void ticTacToeParallelLearning(BasicQValuesAgent<QTable>& learner, const Opponent& opponent, const char learnerPlayer,
+                               const int episodes, const unsigned threadsCount, const std::uint64_t seed,
+                               TrainingTelemetry* telemetry = nullptr, const UpdateRuleOptions& updateRule = {})
+{
+    static_assert(QTable::CONCURRENT, "parallel learning needs a Q-table that supports concurrent updates");
+
+    constexpr int EPISODES_CHUNK = TELEMETRY_FLUSH_PERIOD;
+    std::atomic<int> nextEpisode{0};
+
+    const auto worker = [&](const unsigned index) {
+        Random random(seed, index);
+        EpisodeStats stats;
+        EpisodeLearner<QTable> learn(learner, updateRule, LEARNING_RATE, DISCOUNT_FACTOR, stats);
+        for (int first = nextEpisode.fetch_add(EPISODES_CHUNK); first < episodes;
+             first = nextEpisode.fetch_add(EPISODES_CHUNK)) {
+            const auto last = std::min(first + EPISODES_CHUNK, episodes);
+            for (int i = first; i < last; ++i) {
+                const auto expRate = double(episodes - i) / episodes;
+                const auto timed = telemetry && TrainingTelemetry::isTimedEpisode(i);
+                if (learnerPlayer == Board::FIRST_PLAYER) {
+                    playEpisodeOfFirstPlayer(learner, opponent, expRate, random, stats, timed, learn);
+                } else {
+                    playEpisodeOfSecondPlayer(learner, opponent, expRate, random, stats, timed, learn);
+                }
+            }
+            if (telemetry) {
+                telemetry->flush(stats, learner.getTable().size());
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned index = 1; index < threadsCount; ++index) {
+        workers.emplace_back(worker, index);
+    }
+    worker(0);
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
+// Applies count transitions sampled from the buffer to the agent, each with
+// the learning rate scaled by its importance-sampling weight at the time it is
+// applied. samples is scratch space kept by the caller between calls.
+template <typename QTable>
+void replayTransitions(BasicQValuesAgent<QTable>& agent, ReplayBuffer& buffer, const std::size_t count,
+                       const bool sortByState, std::vector<std::uint64_t>& samples, Random& random, EpisodeStats& stats)
+{
+    if (buffer.size() == 0) {
+        return;
+    }
+    // The state of a sample goes above its index, so sorting the plain numbers orders them by state.
+    samples.resize(count);
+    for (auto& sample : samples) {
+        const auto index = buffer.sample(random);
+        sample = std::uint64_t(buffer[index].state) << 32 | index;
+    }
+    if (sortByState) {
+        std::sort(samples.begin(), samples.end());
+    }
+    for (const auto sample : samples) {
+        const auto index = std::size_t(sample & 0xFFFFFFFF);
+        const auto& transition = buffer[index];
+        const auto learningRate = LEARNING_RATE * buffer.getWeight(index);
+        const auto update = agent.updateQValues(transition.state, transition.nextState, Board::toAction(transition.cell),
+                                                transition.reward, learningRate, DISCOUNT_FACTOR);
+        stats.addUpdate(update);
+        buffer.setError(index, update / learningRate);
+    }
+}
+
+// ticTacToeParallelLearning() with experience replay: the episodes of a chunk
+// only record their transitions into the worker's replay buffer, then the
+// worker applies replayRatio times as many transitions sampled from the
+// buffer, so simulation and table updates each run in a loop of their own.
+template <typename QTable, typename Opponent>
+void ticTacToeReplayLearning(BasicQValuesAgent<QTable>& learner, const Opponent& opponent, const char learnerPlayer,
+                             const int episodes, const unsigned threadsCount, const std::uint64_t seed,
+                             const ReplayOptions& options, TrainingTelemetry* telemetry = nullptr)
+{
+    static_assert(QTable::CONCURRENT, "parallel learning needs a Q-table that supports concurrent updates");
+
+    constexpr int EPISODES_CHUNK = TELEMETRY_FLUSH_PERIOD;
+    std::atomic<int> nextEpisode{0};
+
+    const auto worker = [&](const unsigned index) {
+        Random random(seed, index);
+        EpisodeStats stats;
+        ReplayBuffer buffer(options);
+        std::vector<std::uint64_t> samples;
+        double replayCredit = 0;
+        const auto record = [&](const Board::State state, const Board::State nextState, const QAction& action,
+                                const double reward) {
+            buffer.add(Transition{state, nextState, std::int8_t(Board::toCell(action)), float(reward)});
+            replayCredit += options.replayRatio;
+        };
+
+        for (int first = nextEpisode.fetch_add(EPISODES_CHUNK); first < episodes;
+             first = nextEpisode.fetch_add(EPISODES_CHUNK)) {
+            const auto last = std::min(first + EPISODES_CHUNK, episodes);
+            for (int i = first; i < last; ++i) {
+                const auto expRate = double(episodes - i) / episodes;
+                const auto timed = telemetry && TrainingTelemetry::isTimedEpisode(i);
+                if (learnerPlayer == Board::FIRST_PLAYER) {
+                    playEpisodeOfFirstPlayer(learner, opponent, expRate, random, stats, timed, record);
+                } else {
+                    playEpisodeOfSecondPlayer(learner, opponent, expRate, random, stats, timed, record);
+                }
+            }
+
+            const auto replays = std::size_t(replayCredit);
+            replayCredit -= double(replays);
+            replayTransitions(learner, buffer, replays, options.sortByState, samples, random, stats);
+            if (telemetry) {
+                telemetry->flush(stats, learner.getTable().size());
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned index = 1; index < threadsCount; ++index) {
+        workers.emplace_back(worker, index);
+    }
+    worker(0);
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
+// Learns from the games of a trajectory log instead of playing them: every game
+// is replayed for learnerPlayer, passes times over the log, with the given
+// update rule. Runs on the calling thread. Records that are not valid games
+// are skipped; returns how many were, once per pass.
+template <typename QTable>
+std::size_t trajectoryLearning(BasicQValuesAgent<QTable>& learner, const TrajectoryLog& log, const char learnerPlayer,
+                        const int passes, TrainingTelemetry* telemetry = nullptr,
+                        const UpdateRuleOptions& updateRule = {})
+{
+    EpisodeStats stats;
+    EpisodeLearner<QTable> learn(learner, updateRule, LEARNING_RATE, DISCOUNT_FACTOR, stats);
+    int episode = 0;
+    std::size_t skipped = 0;
+    for (int pass = 0; pass < passes; ++pass) {
+        for (const auto& record : log) {
+            if (!forEachTransition(record, learnerPlayer, learn)) {
+                ++skipped;
+                continue;
+            }
+            const auto outcome = record.winner == learnerPlayer      ? EpisodeOutcome::Win
+                                 : record.winner == Board::EMPTY_CELL ? EpisodeOutcome::Draw
+                                                                      : EpisodeOutcome::Loss;
+            stats.addEpisode(record.movesCount, outcome);
+            if (telemetry && ++episode % TELEMETRY_FLUSH_PERIOD == 0) {
+                telemetry->flush(stats, learner.getTable().size());
+            }
+        }
+    }
+    if (telemetry) {
+        telemetry->flush(stats, learner.getTable().size());
+    }
+    return skipped;
+}
+
+struct NetworkTrainingOptions {
+    std::size_t batchSize = 32;
+    double learningRate = 0.05;
+    double discount = DISCOUNT_FACTOR;
+};
+
+// Plays one episode of a network agent as learnerPlayer on any board, passing
+// every transition of the agent to learn(transition). Rewards are shaped as in
+// the Q-table episodes: aggressively for the first player, defensively for the second.
+template <typename NetworkAgent, typename Opponent, typename Learn>
+void playNetworkEpisode(const NetworkAgent& learner, const Opponent& opponent, const char learnerPlayer,
+                        const double expRate, Random& random, EpisodeStats& stats, Learn&& learn)
+{
+    using GameBoard = typename NetworkAgent::BoardType;
+    const auto opponentPlayer = getOponent(learnerPlayer);
+    const auto getReward = [&](const GameBoard& game) {
+        return learnerPlayer == GameBoard::FIRST_PLAYER ? game.getAggressiveReward(learnerPlayer)
+                                                        : game.getDefensiveReward(learnerPlayer);
+    };
+
+    GameBoard game;
+    typename NetworkAgent::Transition transition{};
+    bool hasTransition = false;
+    int steps = 0;
+    auto outcome = EpisodeOutcome::Draw;
+    auto currentPlayer = GameBoard::FIRST_PLAYER;
+
+    while (true) {
+        if (currentPlayer == learnerPlayer) {
+            transition.first = game.getMask(GameBoard::FIRST_PLAYER);
+            transition.second = game.getMask(GameBoard::SECOND_PLAYER);
+            const auto action = learner.chooseAction(game, expRate, random);
+            transition.cell = GameBoard::toCell(action);
+            game.move(action, learnerPlayer);
+            ++steps;
+            hasTransition = true;
+            if (game.isOver()) {
+                outcome = game.checkWin(learnerPlayer) ? EpisodeOutcome::Win : EpisodeOutcome::Draw;
+                transition.reward = float(getReward(game));
+                transition.terminal = true;
+                learn(transition);
+                break;
+            }
+        } else {
+            game.move(opponent.chooseAction(game, random), opponentPlayer);
+            ++steps;
+            const auto isOver = game.isOver();
+            if (isOver && game.checkWin(opponentPlayer)) {
+                outcome = EpisodeOutcome::Loss;
+            }
+            if (hasTransition) {
+                transition.nextFirst = game.getMask(GameBoard::FIRST_PLAYER);
+                transition.nextSecond = game.getMask(GameBoard::SECOND_PLAYER);
+                transition.reward = !isOver ? 0.0f : outcome == EpisodeOutcome::Loss ? -1.0f : float(getReward(game));
+                transition.terminal = isOver;
+                learn(transition);
+            }
+            if (isOver) {
+                break;
+            }
+        }
+        currentPlayer = getOponent(currentPlayer);
+    }
+
+    stats.addEpisode(steps, outcome);
+}
+
+// Learning loop of a network agent: transitions are collected into minibatches
+// of options.batchSize, each applied as one SGD step. Runs on the calling thread.
+template <typename NetworkAgent, typename Opponent>
+void networkLearning(NetworkAgent& learner, const Opponent& opponent, const char learnerPlayer, const int episodes,
+                     const NetworkTrainingOptions& options, Random& random, TrainingTelemetry* telemetry = nullptr)
+{
+    EpisodeStats stats;
+    std::vector<typename NetworkAgent::Transition> batch;
+    batch.reserve(options.batchSize);
+    const auto learn = [&](const typename NetworkAgent::Transition& transition) {
+        batch.push_back(transition);
+        if (batch.size() == options.batchSize) {
+            const auto error = learner.learn(batch.data(), batch.size(), options.learningRate, options.discount);
+            stats.addUpdate(options.learningRate * error);
+            batch.clear();
+        }
+    };
+
+    for (int i = 0; i < episodes; ++i) {
+        const auto expRate = double(episodes - i) / episodes;
+        playNetworkEpisode(learner, opponent, learnerPlayer, expRate, random, stats, learn);
+        if (telemetry && ((i + 1) % TELEMETRY_FLUSH_PERIOD == 0 || i + 1 == episodes)) {
+            telemetry->flush(stats, learner.getParametersCount());
+        }
+    }
+    learner.learn(batch.data(), batch.size(), options.learningRate, options.discount);
+}
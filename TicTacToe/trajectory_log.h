@@ -0,0 +1,301 @@
+#pragma once
+
+#include <fstream>
+#include <vector>
+#include <string>
+#include <optional>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include "game.h"
+#include "random.h"
+#include "thread_pool.h"
+#include "checkpoint.h"
+
+// One whole game: its cells in the order they were played, the first player
+// moving first, and the winner. Rewards are not stored, they follow from the
+// game and the seat a learner takes when it is replayed.
+struct TrajectoryRecord {
+    std::int8_t cells[Board::CELLS_COUNT];
+    std::uint8_t movesCount;
+    // Board::FIRST_PLAYER, Board::SECOND_PLAYER or Board::EMPTY_CELL for a draw.
+    char winner;
+    char reserved[16 - Board::CELLS_COUNT - 2];
+};
+
+static_assert(sizeof(TrajectoryRecord) == 16, "trajectory records are fixed width");
+
+// Binary trajectory log:
+//   TrajectoryLogHeader (64 bytes)
+//   records: episodesCount x TrajectoryRecord
+// in host byte order, so records are read in place from a memory mapping;
+// the checksum is FNV-1a over the records.
+struct TrajectoryLogHeader {
+    constexpr static const char MAGIC[8] = {'T', 'T', 'T', 'T', 'R', 'A', 'J', '\0'};
+    constexpr static const std::uint32_t VERSION = 1;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+    std::uint32_t boardSize;
+    std::uint32_t winLength;
+    std::uint64_t episodesCount;
+    std::uint64_t checksum;
+    char reserved[24];
+};
+
+static_assert(sizeof(TrajectoryLogHeader) == 64, "trajectory log header layout changed");
+
+// Appends records to a new log through a buffer of BUFFER_RECORDS records.
+// The header, with the number of records and their checksum, is written by
+// close(), so a log is only valid once closed; the destructor closes it.
+class TrajectoryRecorder final {
+public:
+    constexpr static const std::size_t BUFFER_RECORDS = 4096;
+
+    explicit TrajectoryRecorder(const std::string& path) : m_file(path, std::ios::binary | std::ios::trunc) {
+        m_buffer.reserve(BUFFER_RECORDS);
+        const TrajectoryLogHeader header{};
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    ~TrajectoryRecorder() {
+        close();
+    }
+
+    TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+    explicit operator bool() const {
+        return bool(m_file);
+    }
+
+    std::uint64_t size() const {
+        return m_episodesCount + m_buffer.size();
+    }
+
+    void add(const TrajectoryRecord& record) {
+        m_buffer.push_back(record);
+        if (m_buffer.size() == BUFFER_RECORDS) {
+            flush();
+        }
+    }
+
+    // Returns whether the whole log was written.
+    bool close() {
+        if (!m_file.is_open()) {
+            return m_written;
+        }
+        flush();
+
+        TrajectoryLogHeader header{};
+        std::memcpy(header.magic, TrajectoryLogHeader::MAGIC, sizeof(header.magic));
+        header.version = TrajectoryLogHeader::VERSION;
+        header.recordSize = sizeof(TrajectoryRecord);
+        header.boardSize = Board::BOARD_SIZE;
+        header.winLength = Board::WIN_LENGTH;
+        header.episodesCount = m_episodesCount;
+        header.checksum = m_checksum;
+        m_file.seekp(0);
+        m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_file.close();
+        m_written = !m_file.fail();
+        return m_written;
+    }
+
+private:
+    void flush() {
+        const auto* data = reinterpret_cast<const char*>(m_buffer.data());
+        const auto size = m_buffer.size() * sizeof(TrajectoryRecord);
+        m_file.write(data, std::streamsize(size));
+        m_checksum = checkpointChecksum(data, size, m_checksum);
+        m_episodesCount += m_buffer.size();
+        m_buffer.clear();
+    }
+
+    std::ofstream m_file;
+    std::vector<TrajectoryRecord> m_buffer;
+    std::uint64_t m_episodesCount = 0;
+    std::uint64_t m_checksum = checkpointChecksum(nullptr, 0);
+    bool m_written = false;
+};
+
+// Records of a log served straight from its memory mapping.
+class TrajectoryLog final {
+public:
+    // Maps the file and validates its header; the checksum pass reads the
+    // whole file, so it can be skipped for logs just written.
+    static std::optional<TrajectoryLog> open(const std::string& path, const bool verifyChecksum = true) {
+        auto file = MappedFile::open(path);
+        if (!file || file->size() < sizeof(TrajectoryLogHeader)) {
+            return std::nullopt;
+        }
+        TrajectoryLog log(std::move(*file));
+
+        const auto& header = log.getHeader();
+        const auto recordsSize = log.m_file.size() - sizeof(TrajectoryLogHeader);
+        if (std::memcmp(header.magic, TrajectoryLogHeader::MAGIC, sizeof(header.magic)) != 0
+            || header.version != TrajectoryLogHeader::VERSION
+            || header.recordSize != sizeof(TrajectoryRecord)
+            || header.boardSize != std::uint32_t(Board::BOARD_SIZE)
+            || header.winLength != std::uint32_t(Board::WIN_LENGTH)
+            || header.episodesCount != recordsSize / sizeof(TrajectoryRecord)
+            || recordsSize % sizeof(TrajectoryRecord) != 0) {
+            return std::nullopt;
+        }
+        if (verifyChecksum && checkpointChecksum(log.m_file.data() + sizeof(TrajectoryLogHeader), recordsSize)
+                                  != header.checksum) {
+            return std::nullopt;
+        }
+        return log;
+    }
+
+    const TrajectoryLogHeader& getHeader() const {
+        return *reinterpret_cast<const TrajectoryLogHeader*>(m_file.data());
+    }
+
+    std::size_t size() const {
+        return std::size_t(getHeader().episodesCount);
+    }
+
+    const TrajectoryRecord* begin() const {
+        return reinterpret_cast<const TrajectoryRecord*>(m_file.data() + sizeof(TrajectoryLogHeader));
+    }
+
+    const TrajectoryRecord* end() const {
+        return begin() + size();
+    }
+
+    const TrajectoryRecord& operator[](const std::size_t index) const {
+        return begin()[index];
+    }
+
+private:
+    explicit TrajectoryLog(MappedFile&& file) : m_file(std::move(file)) {}
+
+    MappedFile m_file;
+};
+
+// Whether the record is a whole game that can be replayed: at most
+// CELLS_COUNT moves, each on a cell of the board not played before, no move
+// after a line is completed, the game over after the last move and its
+// winner the recorded one, as rewards are taken from it. Records of logs
+// opened without the checksum pass are not known to be.
+inline bool isValidRecord(const TrajectoryRecord& record) {
+    if (record.movesCount > Board::CELLS_COUNT) {
+        return false;
+    }
+    Board::Mask masks[2] = {0, 0};
+    char winner = Board::EMPTY_CELL;
+    for (int move = 0; move < record.movesCount; ++move) {
+        const auto cell = record.cells[move];
+        if (winner != Board::EMPTY_CELL || cell < 0 || cell >= Board::CELLS_COUNT
+            || ((masks[0] | masks[1]) >> cell & 1)) {
+            return false;
+        }
+        const auto player = move % 2;
+        masks[player] |= Board::Mask(1 << cell);
+        if (Board::hasLine(masks[player])) {
+            winner = player == 0 ? Board::FIRST_PLAYER : Board::SECOND_PLAYER;
+        }
+    }
+    if (winner == Board::EMPTY_CELL && record.movesCount != Board::CELLS_COUNT) {
+        return false;
+    }
+    return record.winner == winner;
+}
+
+// Passes the transitions of learnerPlayer in a recorded game to
+// learn(state, nextState, action, reward), the same ones in the same order as
+// playEpisodeOfFirstPlayer() and playEpisodeOfSecondPlayer() give for that game:
+// one per move of the learner, nextState being the state after the opponent's
+// reply, Board::NO_STATE at the end of the game, where the first player's
+// reward is shaped aggressively, the second one's defensively, and a loss
+// costs -1. States are built from the masks, no Board is replayed.
+// Returns false, passing nothing, for a record that is not isValidRecord().
+template <typename Learn>
+bool forEachTransition(const TrajectoryRecord& record, const char learnerPlayer, Learn&& learn) {
+    if (!isValidRecord(record)) {
+        return false;
+    }
+    const auto learnerIndex = learnerPlayer == Board::FIRST_PLAYER ? 0 : 1;
+    const auto getState = [](const Board::Mask* masks) {
+        return Board::State(Board::TERNARY_DIGITS[masks[0]] + 2 * Board::TERNARY_DIGITS[masks[1]]);
+    };
+    const auto getFinalReward = [&]() -> QValue {
+        if (record.winner == Board::EMPTY_CELL) {
+            return learnerIndex == 0 ? 0.5 : 1.0;
+        }
+        if (record.winner != learnerPlayer) {
+            return -1.0;
+        }
+        return learnerIndex == 0 ? 1.0 : 0.5;
+    };
+
+    Board::Mask masks[2] = {0, 0};
+    auto state = Board::NO_STATE;
+    int action = -1;
+    for (int move = 0; move < record.movesCount; ++move) {
+        const auto player = move % 2;
+        if (player == learnerIndex) {
+            if (action >= 0) {
+                learn(state, getState(masks), Board::toAction(action), 0.0);
+            }
+            state = getState(masks);
+            action = record.cells[move];
+        }
+        masks[player] |= Board::Mask(1 << record.cells[move]);
+    }
+    if (action >= 0) {
+        learn(state, Board::NO_STATE, Board::toAction(action), getFinalReward());
+    }
+    return true;
+}
+
+// Plays gamesCount games between the agents and records them in order. Games
+// are split into shards as evaluateAgent() does, so the log depends on the
+// seed only and not on how many threads the pool has.
+template <typename FirstAgent, typename SecondAgent>
+void recordGames(const FirstAgent& firstAgent, const SecondAgent& secondAgent, const int gamesCount,
+                 const std::uint64_t seed, ThreadPool& pool, TrajectoryRecorder& recorder) {
+    constexpr int SHARD_SIZE = 256;
+    // Shards played before their records are appended, which bounds the memory used.
+    constexpr int ROUND_SHARDS = 64;
+
+    const auto shardsCount = (gamesCount + SHARD_SIZE - 1) / SHARD_SIZE;
+    std::vector<std::vector<TrajectoryRecord>> shards(std::min(shardsCount, ROUND_SHARDS));
+    for (int firstShard = 0; firstShard < shardsCount; firstShard += ROUND_SHARDS) {
+        const auto roundShards = std::min(ROUND_SHARDS, shardsCount - firstShard);
+        pool.parallelFor(std::size_t(roundShards), [&](const std::size_t index) {
+            const auto shard = firstShard + int(index);
+            Random random(seed, std::uint64_t(shard));
+            auto& records = shards[index];
+            records.clear();
+            const auto first = shard * SHARD_SIZE;
+            const auto last = std::min(first + SHARD_SIZE, gamesCount);
+            for (int i = first; i < last; ++i) {
+                TrajectoryRecord record{};
+                Board game;
+                char currentPlayer = Board::FIRST_PLAYER;
+                while (!game.isOver()) {
+                    const auto action = currentPlayer == Board::FIRST_PLAYER ? firstAgent.chooseAction(game, random)
+                                                                             : secondAgent.chooseAction(game, random);
+                    record.cells[record.movesCount++] = std::int8_t(Board::toCell(action));
+                    game.move(action, currentPlayer);
+                    currentPlayer = getOponent(currentPlayer);
+                }
+                record.winner = game.checkWin(Board::FIRST_PLAYER)    ? Board::FIRST_PLAYER
+                                : game.checkWin(Board::SECOND_PLAYER) ? Board::SECOND_PLAYER
+                                                                      : Board::EMPTY_CELL;
+                records.push_back(record);
+            }
+        });
+        for (int index = 0; index < roundShards; ++index) {
+            for (const auto& record : shards[index]) {
+                recorder.add(record);
+            }
+        }
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Fixed-size always-replace cache of search results keyed by Board::getHash().
+// The score stored with an entry is exact or only a bound, depending on
+// whether the search that produced it was cut off by the alpha-beta window.
+// Each entry is packed into one atomic word (high key bits, best move,
+// searched depth, 16-bit score, bound, used flag), so threads can share the
+// table without locking.
+class TranspositionTable final {
+public:
+    enum class Bound : std::uint8_t {
+        Exact,
+        Lower,
+        Upper
+    };
+
+    // Depth of results searched to the end of the game.
+    constexpr static const int FULL_DEPTH = 0xFF;
+    constexpr static const int NO_MOVE = 0xFF;
+
+    struct Entry {
+        int score = 0;
+        Bound bound = Bound::Exact;
+        // Plies searched below the position, FULL_DEPTH when unlimited.
+        int depth = FULL_DEPTH;
+        // Cell of the best or refuting move, NO_MOVE when unknown.
+        int move = NO_MOVE;
+    };
+
+    // Keys are verified by their bits above KEY_SHIFT, so at most KEY_SHIFT bits index the table.
+    constexpr static const int KEY_SHIFT = 35;
+
+    explicit TranspositionTable(const int sizeLog2 = 14)
+        : m_entries(std::size_t(1) << sizeLog2)
+        , m_mask((std::size_t(1) << sizeLog2) - 1) {
+        clear();
+    }
+
+    bool probe(const std::uint64_t key, Entry& entry) const {
+        const auto word = m_entries[key & m_mask].load(std::memory_order_relaxed);
+        if (!(word & 1) || (word ^ key) >> KEY_SHIFT) {
+            return false;
+        }
+        entry.score = std::int16_t(word >> 3);
+        entry.bound = Bound((word >> 1) & 3);
+        entry.depth = int((word >> 19) & 0xFF);
+        entry.move = int((word >> 27) & 0xFF);
+        return true;
+    }
+
+    void store(const std::uint64_t key, const int score, const Bound bound, const int depth = FULL_DEPTH,
+               const int move = NO_MOVE) {
+        const auto word = (key >> KEY_SHIFT << KEY_SHIFT)
+                          | std::uint64_t(std::uint8_t(move)) << 27
+                          | std::uint64_t(std::uint8_t(depth)) << 19
+                          | std::uint64_t(std::uint16_t(score)) << 3
+                          | std::uint64_t(bound) << 1
+                          | 1;
+        m_entries[key & m_mask].store(word, std::memory_order_relaxed);
+    }
+
+    // Tightens [alpha, beta] with a stored entry; returns true when the
+    // entry alone decides the node and score holds its value.
+    static bool narrow(const Entry& entry, int& alpha, int& beta, int& score) {
+        switch (entry.bound) {
+        case Bound::Exact:
+            score = entry.score;
+            return true;
+        case Bound::Lower:
+            alpha = alpha > entry.score ? alpha : entry.score;
+            break;
+        case Bound::Upper:
+            beta = beta < entry.score ? beta : entry.score;
+            break;
+        }
+        score = entry.score;
+        return alpha >= beta;
+    }
+
+    static Bound classify(const int score, const int alpha, const int beta) {
+        if (score <= alpha) {
+            return Bound::Upper;
+        }
+        if (score >= beta) {
+            return Bound::Lower;
+        }
+        return Bound::Exact;
+    }
+
+    void clear() {
+        for (auto& entry : m_entries) {
+            entry.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::vector<std::atomic<std::uint64_t>> m_entries;
+    const std::size_t m_mask;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+
+#include "game.h"
+#include "qvalues_agent.h"
+#include "telemetry.h"
+
+// How the transitions of an episode update the Q-values:
+// OneStep is BasicQValuesAgent::updateQValues() at every transition;
+// NStep moves Q(s, a) towards the discounted rewards of the next steps
+// transitions plus the discounted largest value of the state reached after them;
+// AccumulatingTraces and ReplacingTraces are Q(lambda) with eligibility
+// traces, the one-step TD error of every transition applied to all
+// earlier pairs of the episode in proportion to their decayed trace.
+// They differ only for pairs visited twice in an episode, which a game
+// never does, so both give the same updates.
+enum class UpdateRule {
+    OneStep,
+    NStep,
+    AccumulatingTraces,
+    ReplacingTraces
+};
+
+struct UpdateRuleOptions {
+    UpdateRule rule = UpdateRule::OneStep;
+    int steps = 3;
+    double lambda = 0.8;
+};
+
+// Learns from the transitions of one episode as they are played: pass it as
+// the learn callback of playEpisodeOfFirstPlayer() or playEpisodeOfSecondPlayer().
+// A player makes at most CELLS_COUNT moves in an episode, so the pending
+// transitions and the traces fit a fixed list; both are cleared by the terminal transition.
+// Traces are not cut after exploratory moves.
+template <typename QTable>
+class EpisodeLearner final {
+    struct Step {
+        Board::State state;
+        QAction action;
+        double reward;
+        double trace;
+    };
+
+public:
+    EpisodeLearner(BasicQValuesAgent<QTable>& agent, const UpdateRuleOptions& options, const double learningRate,
+                   const double discount, EpisodeStats& stats)
+        : m_agent(agent)
+        , m_options(options)
+        , m_learningRate(learningRate)
+        , m_discount(discount)
+        , m_stats(stats) {}
+
+    void operator()(const Board::State state, const Board::State nextState, const QAction& action, const double reward) {
+        switch (m_options.rule) {
+        case UpdateRule::OneStep:
+            m_stats.addUpdate(m_agent.updateQValues(state, nextState, action, reward, m_learningRate, m_discount));
+            break;
+        case UpdateRule::NStep:
+            learnNStep(state, nextState, action, reward);
+            break;
+        case UpdateRule::AccumulatingTraces:
+        case UpdateRule::ReplacingTraces:
+            learnWithTraces(state, nextState, action, reward);
+            break;
+        }
+        if (nextState == Board::NO_STATE) {
+            m_steps.clear();
+            m_first = 0;
+        }
+    }
+
+private:
+    void learnNStep(const Board::State state, const Board::State nextState, const QAction& action, const double reward) {
+        m_steps.push_back(Step{state, action, reward, 0});
+        if (nextState == Board::NO_STATE) {
+            while (m_first < m_steps.size()) {
+                updateFirstStep(0);
+            }
+        } else if (m_steps.size() - m_first == std::size_t(m_options.steps)) {
+            updateFirstStep(m_agent.getMaxQValue(nextState));
+        }
+    }
+
+    // Updates the oldest pending step with the return of the pending steps
+    // bootstrapped from tailValue, the value after the last of them.
+    void updateFirstStep(const QValue tailValue) {
+        QValue target = tailValue;
+        for (auto i = m_steps.size(); i-- > m_first;) {
+            target = m_steps[i].reward + m_discount * target;
+        }
+        const auto& first = m_steps[m_first];
+        m_stats.addUpdate(m_agent.addQValueError(first.state, first.action,
+                                                 target - m_agent.getQValue(first.state, first.action),
+                                                 m_learningRate));
+        ++m_first;
+    }
+
+    void learnWithTraces(const Board::State state, const Board::State nextState, const QAction& action,
+                         const double reward) {
+        const auto error = reward + m_discount * m_agent.getMaxQValue(nextState) - m_agent.getQValue(state, action);
+
+        // Every move adds a stone, so states never repeat within an episode:
+        // the pair is always new and both kinds of traces start it at 1.
+        m_steps.push_back(Step{state, action, reward, 1});
+
+        for (auto& step : m_steps) {
+            m_stats.addUpdate(m_agent.addQValueError(step.state, step.action, error * step.trace, m_learningRate));
+            step.trace *= m_discount * m_options.lambda;
+        }
+    }
+
+    BasicQValuesAgent<QTable>& m_agent;
+    const UpdateRuleOptions m_options;
+    const double m_learningRate;
+    const double m_discount;
+    EpisodeStats& m_stats;
+
+    FixedList<Step, Board::CELLS_COUNT> m_steps;
+    std::size_t m_first = 0;
+};
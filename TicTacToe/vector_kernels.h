@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Float kernels of the network agents (see network_agent.h), vectorized with
+// AVX2 when the build enables it and plain loops otherwise. Lengths are
+// multiples of VECTOR_LANES: callers pad their rows with zeros.
+constexpr std::size_t VECTOR_LANES = 8;
+
+constexpr std::size_t paddedToLanes(const std::size_t count) {
+    return (count + VECTOR_LANES - 1) / VECTOR_LANES * VECTOR_LANES;
+}
+
+inline float dotProduct(const float* a, const float* b, const std::size_t count) {
+#if defined(__AVX2__)
+    // Two accumulators hide the latency of the additions.
+    auto sum0 = _mm256_setzero_ps();
+    auto sum1 = _mm256_setzero_ps();
+    std::size_t i = 0;
+    for (; i + 2 * VECTOR_LANES <= count; i += 2 * VECTOR_LANES) {
+        sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + VECTOR_LANES),
+                                                 _mm256_loadu_ps(b + i + VECTOR_LANES)));
+    }
+    if (i < count) {
+        sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    const auto sum = _mm256_add_ps(sum0, sum1);
+    auto half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_movehdup_ps(half));
+    return _mm_cvtss_f32(half);
+#else
+    float sum = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+#endif
+}
+
+// y += x
+inline void addVector(float* y, const float* x, const std::size_t count) {
+#if defined(__AVX2__)
+    for (std::size_t i = 0; i < count; i += VECTOR_LANES) {
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_loadu_ps(x + i)));
+    }
+#else
+    for (std::size_t i = 0; i < count; ++i) {
+        y[i] += x[i];
+    }
+#endif
+}
+
+// y += scale * x
+inline void addScaled(float* y, const float* x, const float scale, const std::size_t count) {
+#if defined(__AVX2__)
+    const auto factor = _mm256_set1_ps(scale);
+    for (std::size_t i = 0; i < count; i += VECTOR_LANES) {
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(factor, _mm256_loadu_ps(x + i))));
+    }
+#else
+    for (std::size_t i = 0; i < count; ++i) {
+        y[i] += scale * x[i];
+    }
+#endif
+}
+
+// x = max(x, 0)
+inline void applyRelu(float* x, const std::size_t count) {
+#if defined(__AVX2__)
+    const auto zero = _mm256_setzero_ps();
+    for (std::size_t i = 0; i < count; i += VECTOR_LANES) {
+        _mm256_storeu_ps(x + i, _mm256_max_ps(_mm256_loadu_ps(x + i), zero));
+    }
+#else
+    for (std::size_t i = 0; i < count; ++i) {
+        x[i] = x[i] > 0 ? x[i] : 0;
+    }
+#endif
+}
+
+// y = scale * x where activations is positive, 0 elsewhere: the gradient
+// of a ReLU layer's input from the gradient x of its output.
+inline void scaleWhereActive(float* y, const float* x, const float scale, const float* activations,
+                             const std::size_t count) {
+#if defined(__AVX2__)
+    const auto factor = _mm256_set1_ps(scale);
+    const auto zero = _mm256_setzero_ps();
+    for (std::size_t i = 0; i < count; i += VECTOR_LANES) {
+        const auto active = _mm256_cmp_ps(_mm256_loadu_ps(activations + i), zero, _CMP_GT_OQ);
+        _mm256_storeu_ps(y + i, _mm256_and_ps(active, _mm256_mul_ps(factor, _mm256_loadu_ps(x + i))));
+    }
+#else
+    for (std::size_t i = 0; i < count; ++i) {
+        y[i] = activations[i] > 0 ? scale * x[i] : 0;
+    }
+#endif
+}